@@ -0,0 +1,125 @@
+/* allocs.c
+ *
+ * Copyright 2019 Christian Kellner
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "allocs.h"
+
+#include <errno.h>
+#include <stdlib.h>
+
+/* Count every heap allocation of the process by interposing
+ * the allocator entry points and forwarding them to glibc's
+ * own implementation. Only the headless tester links this,
+ * and only on glibc. GLib allocates through malloc, so this
+ * includes GDBus' messages, tasks and replies as well as the
+ * work of its worker thread. Memory is still released with
+ * the regular free (). */
+
+extern void *__libc_malloc (size_t size);
+extern void *__libc_calloc (size_t nmemb,
+                            size_t size);
+extern void *__libc_realloc (void  *ptr,
+                             size_t size);
+extern void *__libc_memalign (size_t alignment,
+                              size_t size);
+
+static guint64 n_allocs;
+
+#define count_alloc() __atomic_fetch_add (&n_allocs, 1, __ATOMIC_RELAXED)
+
+void *
+malloc (size_t size)
+{
+  count_alloc ();
+  return __libc_malloc (size);
+}
+
+void *
+calloc (size_t nmemb,
+        size_t size)
+{
+  count_alloc ();
+  return __libc_calloc (nmemb, size);
+}
+
+void *
+realloc (void  *ptr,
+         size_t size)
+{
+  count_alloc ();
+  return __libc_realloc (ptr, size);
+}
+
+void *
+memalign (size_t alignment,
+          size_t size)
+{
+  count_alloc ();
+  return __libc_memalign (alignment, size);
+}
+
+/* __libc_memalign rounds bad alignments up, aligned_alloc
+ * and posix_memalign have to reject them */
+static gboolean
+alignment_is_valid (size_t alignment)
+{
+  return alignment != 0 && (alignment & (alignment - 1)) == 0;
+}
+
+void *
+aligned_alloc (size_t alignment,
+               size_t size)
+{
+  if (!alignment_is_valid (alignment))
+    {
+      errno = EINVAL;
+      return NULL;
+    }
+
+  count_alloc ();
+  return __libc_memalign (alignment, size);
+}
+
+int
+posix_memalign (void **memptr,
+                size_t alignment,
+                size_t size)
+{
+  void *mem;
+
+  if (alignment % sizeof (void *) != 0 || !alignment_is_valid (alignment))
+    return EINVAL;
+
+  count_alloc ();
+  mem = __libc_memalign (alignment, size);
+
+  if (mem == NULL)
+    return ENOMEM;
+
+  *memptr = mem;
+
+  return 0;
+}
+
+/* allocations made by all threads so far */
+guint64
+gmt_allocs_get (void)
+{
+  return __atomic_load_n (&n_allocs, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,555 @@
+/* bench.c
+ *
+ * Copyright 2019 Christian Kellner
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "bench.h"
+#include "call.h"
+
+#include <string.h>
+#include <unistd.h>
+
+typedef struct BenchMethod_
+{
+  const char *method;  /* as called, i.e. daemon or portal */
+  const char *request;
+  GmtCallArgs args;
+  GArray     *samples; /* gint64, usec */
+  guint       errors;
+} BenchMethod;
+
+/* One iteration registers, queries and unregisters
+ * the target with each kind of method, so that the
+ * variants are interleaved over the whole run. */
+static const struct
+{
+  const char *request;
+  GmtCallArgs args;
+} bench_methods[] = {
+  {"RegisterGame", GMT_CALL_ARGS_PID},
+  {"QueryStatus", GMT_CALL_ARGS_PID},
+  {"UnregisterGame", GMT_CALL_ARGS_PID},
+  {"RegisterGame", GMT_CALL_ARGS_PID_PAIR},
+  {"QueryStatus", GMT_CALL_ARGS_PID_PAIR},
+  {"UnregisterGame", GMT_CALL_ARGS_PID_PAIR},
+  {"RegisterGame", GMT_CALL_ARGS_PIDFD_PAIR},
+  {"QueryStatus", GMT_CALL_ARGS_PIDFD_PAIR},
+  {"UnregisterGame", GMT_CALL_ARGS_PIDFD_PAIR},
+};
+
+#define N_BENCH_METHODS G_N_ELEMENTS (bench_methods)
+
+/* unmeasured rounds to fill caches and pools */
+#define BENCH_WARMUP 1
+
+struct GmtBench_
+{
+  guint       iterations;
+  gint32      target;
+  gint32      requester;
+  gboolean    portal;
+  gboolean    steady;
+
+  GDBusConnection *bus; /* NULL: session bus */
+  GmtCallPool *pool;
+
+  /* opened once, like a launcher would */
+  int         target_fd;
+  int         requester_fd;
+  char       *pidfd_error;
+
+  BenchMethod methods[N_BENCH_METHODS];
+
+  /* run state */
+  GTask      *task;
+  guint       iteration;
+  guint       step;
+  gint64      start;
+
+  /* heap allocations of the whole process, if there is a
+   * counter, and duration of the measured calls */
+  GmtBenchCounter count_allocs;
+  guint64     allocs_start;
+  guint64     allocs;
+  guint       calls;
+  gint64      started;
+  gint64      duration;
+};
+
+GmtBench *
+gmt_bench_new (guint    iterations,
+               gint32   target,
+               gint32   requester,
+               gboolean portal,
+               gboolean steady)
+{
+  GmtBench *bench;
+
+  bench = g_slice_new0 (GmtBench);
+  bench->iterations = iterations;
+  bench->target = target;
+  bench->requester = requester;
+  bench->portal = portal;
+  bench->steady = steady;
+  bench->target_fd = -1;
+  bench->requester_fd = -1;
+
+  for (guint i = 0; i < N_BENCH_METHODS; i++)
+    {
+      BenchMethod *m = &bench->methods[i];
+
+      m->request = bench_methods[i].request;
+      m->args = bench_methods[i].args;
+      m->method = gmt_call_method (m->request, m->args, portal);
+      m->samples = g_array_sized_new (FALSE, FALSE, sizeof (gint64), iterations);
+    }
+
+  return bench;
+}
+
+void
+gmt_bench_free (GmtBench *bench)
+{
+  if (bench == NULL)
+    return;
+
+  if (bench->target_fd > -1)
+    close (bench->target_fd);
+
+  if (bench->requester_fd > -1)
+    close (bench->requester_fd);
+
+  for (guint i = 0; i < N_BENCH_METHODS; i++)
+    g_array_unref (bench->methods[i].samples);
+
+  g_free (bench->pidfd_error);
+  g_clear_pointer (&bench->pool, gmt_call_pool_free);
+  g_clear_object (&bench->bus);
+  g_clear_object (&bench->task);
+  g_slice_free (GmtBench, bench);
+}
+
+/* running */
+static void bench_next (GmtBench *bench);
+
+static void
+bench_record (GmtBench *bench,
+              gboolean  completed,
+              gboolean  failed)
+{
+  BenchMethod *m = &bench->methods[bench->step];
+  gint64 elapsed;
+
+  elapsed = g_get_monotonic_time () - bench->start;
+
+  if (bench->iteration >= BENCH_WARMUP)
+    {
+      if (completed)
+        g_array_append_val (m->samples, elapsed);
+
+      if (failed)
+        m->errors++;
+
+      bench->calls++;
+    }
+
+  bench->step++;
+  bench_next (bench);
+}
+
+static void
+on_bench_call_ready (GObject      *source,
+                     GAsyncResult *res,
+                     gpointer      user_data)
+{
+  g_autoptr(GError) err = NULL;
+  GmtBench *bench = user_data;
+
+  gmt_call_gamemode_finish (res, &err);
+
+  if (err)
+    g_debug ("bench: %s: %s", bench->methods[bench->step].method, err->message);
+
+  /* an error code from GameMode is still a full round trip */
+  bench_record (bench,
+                err == NULL || err->domain == GMT_CALL_ERROR,
+                err != NULL);
+}
+
+static void
+on_bench_pool_ready (int           result,
+                     const GError *error,
+                     gpointer      user_data)
+{
+  GmtBench *bench = user_data;
+
+  if (error)
+    g_debug ("bench: %s: %s", bench->methods[bench->step].method, error->message);
+
+  bench_record (bench, error == NULL, error != NULL || result < 0);
+}
+
+static void
+bench_next (GmtBench *bench)
+{
+  g_autoptr(GUnixFDList) fds = NULL;
+  g_autoptr(GError) err = NULL;
+  GCancellable *cancellable;
+  GVariant *params;
+  BenchMethod *m;
+
+  cancellable = g_task_get_cancellable (bench->task);
+
+  if (g_cancellable_set_error_if_cancelled (cancellable, &err))
+    {
+      GTask *task = g_steal_pointer (&bench->task);
+
+      g_task_return_error (task, g_steal_pointer (&err));
+      g_object_unref (task);
+      return;
+    }
+
+  if (bench->step == N_BENCH_METHODS)
+    {
+      bench->step = 0;
+      bench->iteration++;
+    }
+
+  /* skip the pidfd methods if we have no pidfds */
+  while (bench->step < N_BENCH_METHODS &&
+         bench->methods[bench->step].args == GMT_CALL_ARGS_PIDFD_PAIR &&
+         bench->target_fd < 0)
+    bench->step++;
+
+  if (bench->step == N_BENCH_METHODS)
+    {
+      bench->step = 0;
+      bench->iteration++;
+    }
+
+  if (bench->iteration == BENCH_WARMUP && bench->step == 0 && bench->calls == 0)
+    {
+      bench->allocs_start = bench->count_allocs ? bench->count_allocs () : 0;
+      bench->started = g_get_monotonic_time ();
+    }
+
+  if (bench->iteration >= bench->iterations + BENCH_WARMUP)
+    {
+      GTask *task = g_steal_pointer (&bench->task);
+
+      if (bench->count_allocs)
+        bench->allocs = bench->count_allocs () - bench->allocs_start;
+
+      bench->duration = g_get_monotonic_time () - bench->started;
+
+      g_task_return_boolean (task, TRUE);
+      g_object_unref (task);
+      return;
+    }
+
+  m = &bench->methods[bench->step];
+
+  if (bench->pool)
+    {
+      bench->start = g_get_monotonic_time ();
+
+      gmt_call_pool_call (bench->pool,
+                          m->request,
+                          m->args,
+                          bench->target,
+                          bench->requester,
+                          on_bench_pool_ready,
+                          bench);
+      return;
+    }
+
+  params = gmt_call_params (m->request, m->args, bench->portal,
+                            bench->target, bench->requester,
+                            bench->target_fd, bench->requester_fd,
+                            NULL, &fds, &err);
+
+  if (params == NULL)
+    {
+      g_debug ("bench: %s: %s", m->method, err->message);
+      bench->start = g_get_monotonic_time ();
+      bench_record (bench, FALSE, TRUE);
+      return;
+    }
+
+  /* the way the window calls GameMode, proxy and all; only
+   * building the parameters is left out */
+  bench->start = g_get_monotonic_time ();
+
+  gmt_call_gamemode (NULL,
+                     bench->bus,
+                     m->method,
+                     params,
+                     fds,
+                     bench->portal,
+                     on_bench_call_ready,
+                     bench);
+}
+
+static void
+on_bench_bus_ready (GObject      *source,
+                    GAsyncResult *res,
+                    gpointer      user_data)
+{
+  g_autoptr(GDBusConnection) bus = NULL;
+  g_autoptr(GError) err = NULL;
+  GmtBench *bench = user_data;
+
+  bus = g_bus_get_finish (res, &err);
+
+  if (bus == NULL)
+    {
+      GTask *task = g_steal_pointer (&bench->task);
+
+      g_task_return_error (task, g_steal_pointer (&err));
+      g_object_unref (task);
+      return;
+    }
+
+  bench->pool = gmt_call_pool_new (bus, bench->portal);
+  bench_next (bench);
+}
+
+/* count heap allocations during the measured calls */
+void
+gmt_bench_set_alloc_counter (GmtBench        *bench,
+                             GmtBenchCounter  counter)
+{
+  g_return_if_fail (bench->task == NULL);
+
+  bench->count_allocs = counter;
+}
+
+/* run against @bus instead of the session bus */
+void
+gmt_bench_set_connection (GmtBench        *bench,
+                          GDBusConnection *bus)
+{
+  g_return_if_fail (bench->task == NULL);
+
+  g_set_object (&bench->bus, bus);
+}
+
+void
+gmt_bench_run_async (GmtBench           *bench,
+                     gpointer            source_object,
+                     GCancellable       *cancellable,
+                     GAsyncReadyCallback callback,
+                     gpointer            user_data)
+{
+  g_autoptr(GError) err = NULL;
+
+  g_return_if_fail (bench->task == NULL);
+
+  bench->task = g_task_new (source_object, cancellable, callback, user_data);
+  bench->iteration = 0;
+  bench->step = 0;
+  bench->calls = 0;
+
+  if (bench->target_fd < 0)
+    bench->target_fd = gmt_pidfd_open (bench->target, &err);
+
+  if (bench->target_fd > -1 && bench->requester_fd < 0)
+    bench->requester_fd = gmt_pidfd_open (bench->requester, &err);
+
+  if (bench->requester_fd < 0 && bench->target_fd > -1)
+    {
+      close (bench->target_fd);
+      bench->target_fd = -1;
+    }
+
+  if (err)
+    {
+      g_debug ("bench: pidfd methods disabled: %s", err->message);
+      bench->pidfd_error = g_strdup (err->message);
+    }
+
+  if (bench->steady && bench->bus == NULL)
+    {
+      g_bus_get (G_BUS_TYPE_SESSION, cancellable, on_bench_bus_ready, bench);
+      return;
+    }
+
+  if (bench->steady)
+    bench->pool = gmt_call_pool_new (bench->bus, bench->portal);
+
+  bench_next (bench);
+}
+
+gboolean
+gmt_bench_run_finish (GmtBench     *bench,
+                      GAsyncResult *res,
+                      GError      **error)
+{
+  g_return_val_if_fail (g_task_is_valid (res, NULL), FALSE);
+
+  return g_task_propagate_boolean (G_TASK (res), error);
+}
+
+/* results */
+static int
+compare_gint64 (gconstpointer a,
+                gconstpointer b)
+{
+  const gint64 *x = a;
+  const gint64 *y = b;
+
+  return (*x > *y) - (*x < *y);
+}
+
+static gint64
+percentile (GArray *sorted,
+            guint   pct)
+{
+  guint idx;
+
+  /* nearest rank */
+  idx = (pct * sorted->len + 99) / 100;
+  idx = CLAMP (idx, 1, sorted->len) - 1;
+
+  return g_array_index (sorted, gint64, idx);
+}
+
+guint
+gmt_bench_get_n_methods (GmtBench *bench)
+{
+  return N_BENCH_METHODS;
+}
+
+gboolean
+gmt_bench_get_stats (GmtBench      *bench,
+                     guint          index,
+                     GmtBenchStats *stats)
+{
+  g_autoptr(GArray) sorted = NULL;
+  BenchMethod *m;
+  gint64 sum = 0;
+
+  g_return_val_if_fail (index < N_BENCH_METHODS, FALSE);
+
+  m = &bench->methods[index];
+
+  memset (stats, 0, sizeof (GmtBenchStats));
+  stats->method = m->method;
+  stats->errors = m->errors;
+  stats->n = m->samples->len;
+
+  if (m->samples->len == 0)
+    return FALSE;
+
+  sorted = g_array_sized_new (FALSE, FALSE, sizeof (gint64), m->samples->len);
+  g_array_append_vals (sorted, m->samples->data, m->samples->len);
+  g_array_sort (sorted, compare_gint64);
+
+  for (guint i = 0; i < sorted->len; i++)
+    sum += g_array_index (sorted, gint64, i);
+
+  stats->min = g_array_index (sorted, gint64, 0);
+  stats->max = g_array_index (sorted, gint64, sorted->len - 1);
+  stats->p50 = percentile (sorted, 50);
+  stats->p90 = percentile (sorted, 90);
+  stats->p99 = percentile (sorted, 99);
+  stats->mean = sum / (double) sorted->len;
+
+  return TRUE;
+}
+
+/* -1 without an allocation counter */
+double
+gmt_bench_get_allocs_per_call (GmtBench *bench)
+{
+  if (bench->count_allocs == NULL)
+    return -1;
+
+  if (bench->calls == 0)
+    return 0;
+
+  return bench->allocs / (double) bench->calls;
+}
+
+guint
+gmt_bench_get_n_calls (GmtBench *bench)
+{
+  return bench->calls;
+}
+
+/* usec for all measured calls, without the warm-up */
+gint64
+gmt_bench_get_duration (GmtBench *bench)
+{
+  return bench->duration;
+}
+
+const char *
+gmt_bench_get_pidfd_error (GmtBench *bench)
+{
+  return bench->pidfd_error;
+}
+
+char *
+gmt_bench_format (GmtBench *bench)
+{
+  GString *str;
+
+  str = g_string_new (NULL);
+  g_string_append_printf (str, "%-22s %5s %5s %7s %7s %7s %7s %8s\n",
+                          "method (usec)", "n", "err",
+                          "min", "p50", "p90", "p99", "mean");
+
+  for (guint i = 0; i < N_BENCH_METHODS; i++)
+    {
+      GmtBenchStats stats;
+      gboolean ok;
+
+      ok = gmt_bench_get_stats (bench, i, &stats);
+
+      if (!ok)
+        {
+          g_string_append_printf (str, "%-22s %5u %5u %7s %7s %7s %7s %8s\n",
+                                  stats.method, stats.n, stats.errors,
+                                  "-", "-", "-", "-", "-");
+          continue;
+        }
+
+      g_string_append_printf (str, "%-22s %5u %5u %7" G_GINT64_FORMAT
+                              " %7" G_GINT64_FORMAT " %7" G_GINT64_FORMAT
+                              " %7" G_GINT64_FORMAT " %8.1f\n",
+                              stats.method, stats.n, stats.errors,
+                              stats.min, stats.p50, stats.p90,
+                              stats.p99, stats.mean);
+    }
+
+  g_string_append (str, bench->steady ? "steady state" : "regular");
+
+  if (bench->count_allocs)
+    g_string_append_printf (str, ", %.2f heap allocations/call (whole process)",
+                            gmt_bench_get_allocs_per_call (bench));
+
+  g_string_append_c (str, '\n');
+
+  if (bench->pidfd_error)
+    g_string_append_printf (str, "pidfd methods skipped: %s\n", bench->pidfd_error);
+
+  g_string_truncate (str, str->len - 1);
+
+  return g_string_free (str, FALSE);
+}
@@ -0,0 +1,83 @@
+/* bench.h
+ *
+ * Copyright 2019 Christian Kellner
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+/* latency statistics of one method, in microseconds */
+typedef struct GmtBenchStats_
+{
+  const char *method;
+  guint       n;
+  guint       errors;
+  gint64      min;
+  gint64      p50;
+  gint64      p90;
+  gint64      p99;
+  gint64      max;
+  double      mean;
+} GmtBenchStats;
+
+typedef struct GmtBench_ GmtBench;
+
+typedef guint64 (*GmtBenchCounter) (void);
+
+GmtBench * gmt_bench_new (guint    iterations,
+                          gint32   target,
+                          gint32   requester,
+                          gboolean portal,
+                          gboolean steady);
+
+void       gmt_bench_free (GmtBench *bench);
+
+void       gmt_bench_set_connection (GmtBench        *bench,
+                                     GDBusConnection *bus);
+
+void       gmt_bench_set_alloc_counter (GmtBench        *bench,
+                                        GmtBenchCounter  counter);
+
+void       gmt_bench_run_async (GmtBench           *bench,
+                                gpointer            source_object,
+                                GCancellable       *cancellable,
+                                GAsyncReadyCallback callback,
+                                gpointer            user_data);
+
+gboolean   gmt_bench_run_finish (GmtBench     *bench,
+                                 GAsyncResult *res,
+                                 GError      **error);
+
+guint      gmt_bench_get_n_methods (GmtBench *bench);
+
+gboolean   gmt_bench_get_stats (GmtBench      *bench,
+                                guint          index,
+                                GmtBenchStats *stats);
+
+double     gmt_bench_get_allocs_per_call (GmtBench *bench);
+
+guint      gmt_bench_get_n_calls (GmtBench *bench);
+
+gint64     gmt_bench_get_duration (GmtBench *bench);
+
+const char * gmt_bench_get_pidfd_error (GmtBench *bench);
+
+char     * gmt_bench_format (GmtBench *bench);
+
+G_END_DECLS
@@ -0,0 +1,610 @@
+/* call.c
+ *
+ * Copyright 2019 Christian Kellner
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "call.h"
+#include "startup.h"
+
+#include <errno.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#ifndef __NR_pidfd_open
+#define __NR_pidfd_open 434
+#endif
+
+G_DEFINE_QUARK (gmt-call-error-quark, gmt_call_error)
+
+/* native gamemode implementation */
+typedef struct CallData_
+{
+  char        *method;
+  GVariant    *params;
+  GUnixFDList *fds;
+  gboolean     portal;
+  GDBusProxy  *proxy;
+} CallData;
+
+static void
+call_data_free (gpointer data)
+{
+  CallData *call = data;
+
+  g_free (call->method);
+  g_variant_unref (call->params);
+  g_clear_object (&call->fds);
+  g_clear_object (&call->proxy);
+  g_slice_free (CallData, call);
+}
+
+static void
+on_gamemode_call_ready (GObject      *source,
+                        GAsyncResult *res,
+                        gpointer      user_data)
+{
+  g_autoptr(GError) err = NULL;
+  g_autoptr(GVariant) val = NULL;
+  g_autoptr(GTask) task = G_TASK (user_data);
+  CallData *call;
+  int r = -1;
+
+  call = g_task_get_task_data (task);
+
+  if (call->fds)
+    val = g_dbus_proxy_call_with_unix_fd_list_finish (call->proxy, NULL, res, &err);
+  else
+    val = g_dbus_proxy_call_finish (call->proxy, res, &err);
+
+  if (val == NULL)
+    {
+      g_warning ("could not talk to gamemode: %s", err->message);
+      g_task_return_error (task, g_steal_pointer (&err));
+      return;
+    }
+
+  gmt_startup_mark (GMT_STARTUP_BUILTIN_CALL);
+
+  g_variant_get (val, "(i)", &r);
+  if (r < 0)
+    {
+      gboolean rejected = r == -2;
+
+      g_task_return_new_error (task, GMT_CALL_ERROR,
+                               rejected ? GMT_CALL_ERROR_REJECTED : GMT_CALL_ERROR_FAILED,
+                               "GameMode %s: request %s", call->method,
+                               rejected ? "rejected" : "failed");
+      return;
+    }
+
+  g_task_return_int (task, r);
+}
+
+static void
+on_proxy_ready (GObject      *source,
+                GAsyncResult *res,
+                gpointer      user_data)
+{
+  g_autoptr(GError) err = NULL;
+  g_autoptr(GTask) task = G_TASK (user_data);
+  CallData *call;
+  const char *name;
+
+  call = g_task_get_task_data (task);
+  call->proxy = g_dbus_proxy_new_finish (res, &err);
+
+  if (call->proxy == NULL)
+    {
+      g_warning ("could not create gamemode proxy: %s", err->message);
+      g_task_return_error (task, g_steal_pointer (&err));
+      return;
+    }
+
+  name = g_dbus_connection_get_unique_name (g_dbus_proxy_get_connection (call->proxy));
+
+  g_debug ("my name: %s", name);
+
+  if (call->fds)
+    g_dbus_proxy_call_with_unix_fd_list (call->proxy,
+                                         call->method,
+                                         call->params,
+                                         G_DBUS_CALL_FLAGS_NONE,
+                                         -1,
+                                         call->fds,
+                                         NULL, /* cancel */
+                                         on_gamemode_call_ready,
+                                         g_steal_pointer (&task));
+  else
+    g_dbus_proxy_call (call->proxy,
+                       call->method,
+                       call->params,
+                       G_DBUS_CALL_FLAGS_NONE,
+                       -1,
+                       NULL, /* cancel */
+                       on_gamemode_call_ready,
+                       g_steal_pointer (&task));
+}
+
+static void
+call_proxy_new (GDBusConnection *bus,
+                GTask           *task)
+{
+  CallData *call = g_task_get_task_data (task);
+  GDBusProxyFlags flags;
+
+  /* the proxy is used for a single call */
+  flags = G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES |
+          G_DBUS_PROXY_FLAGS_DO_NOT_CONNECT_SIGNALS |
+          G_DBUS_PROXY_FLAGS_DO_NOT_AUTO_START_AT_CONSTRUCTION;
+
+  g_dbus_proxy_new (bus,
+                    flags,
+                    NULL,
+                    call->portal ? PORTAL_DBUS_NAME : GAMEMODE_DBUS_NAME,
+                    call->portal ? PORTAL_DBUS_PATH : GAMEMODE_DBUS_PATH,
+                    call->portal ? PORTAL_DBUS_IFACE : GAMEMODE_DBUS_IFACE,
+                    NULL,
+                    on_proxy_ready,
+                    task);
+}
+
+static void
+on_bus_ready (GObject      *source,
+              GAsyncResult *res,
+              gpointer      user_data)
+{
+  g_autoptr(GDBusConnection) bus = NULL;
+  g_autoptr(GError) err = NULL;
+  GTask *task = G_TASK (user_data);
+
+  bus = g_bus_get_finish (res, &err);
+
+  if (bus == NULL)
+    {
+      g_warning ("could not connect to the session bus: %s", err->message);
+      g_task_return_error (task, g_steal_pointer (&err));
+      g_object_unref (task);
+      return;
+    }
+
+  gmt_startup_mark (GMT_STARTUP_BUS);
+  call_proxy_new (bus, task);
+}
+
+/* @bus may be %NULL for the session bus */
+void
+gmt_call_gamemode (gpointer            source_object,
+                   GDBusConnection    *bus,
+                   const char         *method,
+                   GVariant           *params,
+                   GUnixFDList        *fds,
+                   gboolean            portal,
+                   GAsyncReadyCallback callback,
+                   gpointer            user_data)
+{
+  CallData *data;
+  GTask *task;
+
+  data = g_slice_new0 (CallData);
+  data->method = g_strdup (method);
+  data->params = g_variant_ref_sink (params);
+  data->fds = fds ? g_object_ref (fds) : NULL;
+  data->portal = portal;
+
+  task = g_task_new (source_object, NULL, callback, user_data);
+  g_task_set_task_data (task, data, call_data_free);
+
+  if (bus != NULL)
+    call_proxy_new (bus, task);
+  else
+    g_bus_get (G_BUS_TYPE_SESSION, NULL, on_bus_ready, task);
+}
+
+int
+gmt_call_gamemode_finish (GAsyncResult *res,
+                          GError      **error)
+{
+  g_autoptr(GError) err = NULL;
+  gssize r;
+
+  r = g_task_propagate_int (G_TASK (res), &err);
+
+  if (g_error_matches (err, GMT_CALL_ERROR, GMT_CALL_ERROR_REJECTED))
+    r = -2;
+
+  if (err)
+    g_propagate_error (error, g_steal_pointer (&err));
+
+  return (int) r;
+}
+
+/* pidfd support */
+int
+gmt_pidfd_open (pid_t    pid,
+                GError **error)
+{
+  int fd;
+
+  fd = (int) syscall (__NR_pidfd_open, pid, 0);
+
+  if (fd < 0)
+    {
+      int err = errno;
+
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (err),
+                   "could not open pidfd for %d: %s",
+                   (int) pid, g_strerror (err));
+    }
+
+  return fd;
+}
+
+/* Parameters for the *ByPIDFd methods; @fds will contain
+ * duplicates of the given pidfds, the handles index it. */
+static GVariant *
+pidfd_params (int           target_fd,
+              int           requester_fd,
+              GUnixFDList **fds,
+              GError      **error)
+{
+  g_autoptr(GUnixFDList) lst = NULL;
+  int target, requester;
+
+  lst = g_unix_fd_list_new ();
+  target = g_unix_fd_list_append (lst, target_fd, error);
+  if (target < 0)
+    return NULL;
+
+  requester = g_unix_fd_list_append (lst, requester_fd, error);
+  if (requester < 0)
+    return NULL;
+
+  *fds = g_steal_pointer (&lst);
+
+  return g_variant_new ("(hh)", target, requester);
+}
+
+/* The daemon and the portal do not agree on the methods that
+ * take a requester: gamemoded exports *ByPID and wants the
+ * requester first, the portal exports *ByPid and wants the
+ * target first. Both want the target's pidfd first. */
+const char *
+gmt_call_method (const char  *request,
+                 GmtCallArgs  args,
+                 gboolean     portal)
+{
+  const char *suffix = "";
+  char buf[64];
+
+  switch (args)
+    {
+    case GMT_CALL_ARGS_PID:
+      return g_intern_string (request);
+
+    case GMT_CALL_ARGS_PID_PAIR:
+      suffix = portal ? "ByPid" : "ByPID";
+      break;
+
+    case GMT_CALL_ARGS_PIDFD_PAIR:
+      suffix = "ByPIDFd";
+      break;
+    }
+
+  g_snprintf (buf, sizeof (buf), "%s%s", request, suffix);
+
+  return g_intern_string (buf);
+}
+
+/* Method name and parameters for @request, i.e. "QueryStatus",
+ * "RegisterGame" or "UnregisterGame". For GMT_CALL_ARGS_PIDFD_PAIR
+ * the given pidfds are used, or opened for the pids if they are
+ * -1, and @fds will contain duplicates of them. */
+GVariant *
+gmt_call_params (const char   *request,
+                 GmtCallArgs   args,
+                 gboolean      portal,
+                 gint32        target,
+                 gint32        requester,
+                 int           target_fd,
+                 int           requester_fd,
+                 const char  **method,
+                 GUnixFDList **fds,
+                 GError      **error)
+{
+  GVariant *params = NULL;
+  int tfd = target_fd;
+  int rfd = requester_fd;
+
+  switch (args)
+    {
+    case GMT_CALL_ARGS_PID:
+      params = g_variant_new ("(i)", target);
+      break;
+
+    case GMT_CALL_ARGS_PID_PAIR:
+      if (portal)
+        params = g_variant_new ("(ii)", target, requester);
+      else
+        params = g_variant_new ("(ii)", requester, target);
+      break;
+
+    case GMT_CALL_ARGS_PIDFD_PAIR:
+      if (tfd < 0)
+        tfd = gmt_pidfd_open (target, error);
+
+      if (tfd > -1 && rfd < 0)
+        rfd = gmt_pidfd_open (requester, error);
+
+      if (tfd > -1 && rfd > -1)
+        params = pidfd_params (tfd, rfd, fds, error);
+
+      if (tfd > -1 && tfd != target_fd)
+        close (tfd);
+
+      if (rfd > -1 && rfd != requester_fd)
+        close (rfd);
+      break;
+    }
+
+  if (params != NULL && method != NULL)
+    *method = gmt_call_method (request, args, portal);
+
+  return params;
+}
+
+/* steady state: call contexts come from a free list and
+ * the parameters of every (request, args, target, requester)
+ * tuple are built once; GDBus still allocates the message,
+ * its task and the reply for every call */
+typedef struct PoolParams_
+{
+  const char  *request; /* interned */
+  GmtCallArgs  args;
+  gint32       target;
+  gint32       requester;
+
+  const char  *method;
+  GVariant    *params;
+  GUnixFDList *fds;
+} PoolParams;
+
+typedef struct PoolCall_
+{
+  GmtCallPool      *pool;
+  PoolParams       *params;
+  GmtCallFunc       func;
+  gpointer          user_data;
+  struct PoolCall_ *next;
+} PoolCall;
+
+struct GmtCallPool_
+{
+  GDBusConnection *bus;
+  gboolean         portal;
+
+  GHashTable      *params;
+  PoolCall        *free_calls;
+  guint            in_flight;
+};
+
+static guint
+pool_params_hash (gconstpointer key)
+{
+  const PoolParams *p = key;
+
+  return g_direct_hash (p->request) ^
+         ((guint) p->args << 24) ^
+         ((guint) p->target * 16777619U) ^
+         (guint) p->requester;
+}
+
+static gboolean
+pool_params_equal (gconstpointer a,
+                   gconstpointer b)
+{
+  const PoolParams *x = a;
+  const PoolParams *y = b;
+
+  return x->request == y->request &&
+         x->args == y->args &&
+         x->target == y->target &&
+         x->requester == y->requester;
+}
+
+static void
+pool_params_free (gpointer data)
+{
+  PoolParams *p = data;
+
+  g_variant_unref (p->params);
+  g_clear_object (&p->fds);
+  g_slice_free (PoolParams, p);
+}
+
+static PoolParams *
+pool_params_new (GmtCallPool      *pool,
+                 const PoolParams *key,
+                 GError          **error)
+{
+  g_autoptr(GUnixFDList) fds = NULL;
+  const char *method = NULL;
+  GVariant *params;
+  PoolParams *p;
+
+  params = gmt_call_params (key->request, key->args, pool->portal,
+                            key->target, key->requester, -1, -1,
+                            &method, &fds, error);
+
+  if (params == NULL)
+    return NULL;
+
+  p = g_slice_new0 (PoolParams);
+  *p = *key;
+  p->method = method;
+  p->params = g_variant_ref_sink (params);
+  p->fds = g_steal_pointer (&fds);
+
+  return p;
+}
+
+static void
+on_pool_call_ready (GObject      *source,
+                    GAsyncResult *res,
+                    gpointer      user_data)
+{
+  g_autoptr(GError) err = NULL;
+  g_autoptr(GVariant) val = NULL;
+  PoolCall *call = user_data;
+  GmtCallPool *pool = call->pool;
+  GmtCallFunc func = call->func;
+  gpointer data = call->user_data;
+  int r = -1;
+
+  if (call->params->fds)
+    val = g_dbus_connection_call_with_unix_fd_list_finish (pool->bus, NULL, res, &err);
+  else
+    val = g_dbus_connection_call_finish (pool->bus, res, &err);
+
+  if (val != NULL)
+    g_variant_get (val, "(i)", &r);
+
+  /* back into the pool first, the callback might call again */
+  call->next = pool->free_calls;
+  pool->free_calls = call;
+  pool->in_flight--;
+
+  func (r, err, data);
+}
+
+GmtCallPool *
+gmt_call_pool_new (GDBusConnection *bus,
+                   gboolean         portal)
+{
+  GmtCallPool *pool;
+
+  pool = g_slice_new0 (GmtCallPool);
+  pool->bus = g_object_ref (bus);
+  pool->portal = portal;
+  pool->params = g_hash_table_new_full (pool_params_hash,
+                                        pool_params_equal,
+                                        pool_params_free,
+                                        NULL);
+
+  return pool;
+}
+
+void
+gmt_call_pool_free (GmtCallPool *pool)
+{
+  if (pool == NULL)
+    return;
+
+  g_return_if_fail (pool->in_flight == 0);
+
+  while (pool->free_calls)
+    {
+      PoolCall *call = pool->free_calls;
+
+      pool->free_calls = call->next;
+      g_slice_free (PoolCall, call);
+    }
+
+  g_hash_table_unref (pool->params);
+  g_object_unref (pool->bus);
+  g_slice_free (GmtCallPool, pool);
+}
+
+/* The callback gets the GameMode result code; the error is
+ * only set if the call itself did not complete. */
+void
+gmt_call_pool_call (GmtCallPool *pool,
+                    const char  *request,
+                    GmtCallArgs  args,
+                    gint32       target,
+                    gint32       requester,
+                    GmtCallFunc  func,
+                    gpointer     user_data)
+{
+  PoolParams key = { 0, };
+  PoolParams *params;
+  PoolCall *call;
+
+  key.request = g_intern_string (request);
+  key.args = args;
+  key.target = target;
+  key.requester = args == GMT_CALL_ARGS_PID ? 0 : requester;
+
+  params = g_hash_table_lookup (pool->params, &key);
+
+  if (params == NULL)
+    {
+      g_autoptr(GError) err = NULL;
+
+      params = pool_params_new (pool, &key, &err);
+
+      if (params == NULL)
+        {
+          func (-1, err, user_data);
+          return;
+        }
+
+      g_hash_table_add (pool->params, params);
+    }
+
+  call = pool->free_calls;
+
+  if (call != NULL)
+    pool->free_calls = call->next;
+  else
+    call = g_slice_new0 (PoolCall);
+
+  call->pool = pool;
+  call->params = params;
+  call->func = func;
+  call->user_data = user_data;
+  call->next = NULL;
+  pool->in_flight++;
+
+  if (params->fds)
+    g_dbus_connection_call_with_unix_fd_list (pool->bus,
+                                              pool->portal ? PORTAL_DBUS_NAME : GAMEMODE_DBUS_NAME,
+                                              pool->portal ? PORTAL_DBUS_PATH : GAMEMODE_DBUS_PATH,
+                                              pool->portal ? PORTAL_DBUS_IFACE : GAMEMODE_DBUS_IFACE,
+                                              params->method,
+                                              params->params,
+                                              G_VARIANT_TYPE ("(i)"),
+                                              G_DBUS_CALL_FLAGS_NONE,
+                                              -1,
+                                              params->fds,
+                                              NULL, /* cancel */
+                                              on_pool_call_ready,
+                                              call);
+  else
+    g_dbus_connection_call (pool->bus,
+                            pool->portal ? PORTAL_DBUS_NAME : GAMEMODE_DBUS_NAME,
+                            pool->portal ? PORTAL_DBUS_PATH : GAMEMODE_DBUS_PATH,
+                            pool->portal ? PORTAL_DBUS_IFACE : GAMEMODE_DBUS_IFACE,
+                            params->method,
+                            params->params,
+                            G_VARIANT_TYPE ("(i)"),
+                            G_DBUS_CALL_FLAGS_NONE,
+                            -1,
+                            NULL, /* cancel */
+                            on_pool_call_ready,
+                            call);
+}
@@ -0,0 +1,104 @@
+/* call.h
+ *
+ * Copyright 2019 Christian Kellner
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+#include <gio/gunixfdlist.h>
+
+#include <sys/types.h>
+
+G_BEGIN_DECLS
+
+#define GAMEMODE_DBUS_NAME "com.feralinteractive.GameMode"
+#define GAMEMODE_DBUS_IFACE "com.feralinteractive.GameMode"
+#define GAMEMODE_DBUS_PATH "/com/feralinteractive/GameMode"
+
+#define PORTAL_DBUS_NAME "org.freedesktop.portal.Desktop"
+#define PORTAL_DBUS_IFACE "org.freedesktop.portal.GameMode"
+#define PORTAL_DBUS_PATH "/org/freedesktop/portal/desktop"
+
+#define GMT_CALL_ERROR (gmt_call_error_quark ())
+GQuark gmt_call_error_quark (void);
+
+/* GameMode answered, but with an error code */
+typedef enum GmtCallError_
+{
+  GMT_CALL_ERROR_FAILED,   /* -1 */
+  GMT_CALL_ERROR_REJECTED, /* -2 */
+} GmtCallError;
+
+void        gmt_call_gamemode (gpointer            source_object,
+                               GDBusConnection    *bus,
+                               const char         *method,
+                               GVariant           *params,
+                               GUnixFDList        *fds,
+                               gboolean            portal,
+                               GAsyncReadyCallback callback,
+                               gpointer            user_data);
+
+int         gmt_call_gamemode_finish (GAsyncResult *res,
+                                      GError      **error);
+
+int         gmt_pidfd_open (pid_t    pid,
+                            GError **error);
+
+typedef enum GmtCallArgs_
+{
+  GMT_CALL_ARGS_PID,        /* (i)  target */
+  GMT_CALL_ARGS_PID_PAIR,   /* (ii) order depends on portal */
+  GMT_CALL_ARGS_PIDFD_PAIR, /* (hh) target, requester */
+} GmtCallArgs;
+
+const char * gmt_call_method (const char  *request,
+                              GmtCallArgs  args,
+                              gboolean     portal);
+
+GVariant  * gmt_call_params (const char   *request,
+                             GmtCallArgs   args,
+                             gboolean      portal,
+                             gint32        target,
+                             gint32        requester,
+                             int           target_fd,
+                             int           requester_fd,
+                             const char  **method,
+                             GUnixFDList **fds,
+                             GError      **error);
+
+/* steady state calls */
+
+typedef void (*GmtCallFunc) (int           result,
+                             const GError *error,
+                             gpointer      user_data);
+
+typedef struct GmtCallPool_ GmtCallPool;
+
+GmtCallPool * gmt_call_pool_new (GDBusConnection *bus,
+                                 gboolean         portal);
+
+void          gmt_call_pool_free (GmtCallPool *pool);
+
+void          gmt_call_pool_call (GmtCallPool *pool,
+                                  const char  *request,
+                                  GmtCallArgs  args,
+                                  gint32       target,
+                                  gint32       requester,
+                                  GmtCallFunc  func,
+                                  gpointer     user_data);
+
+G_END_DECLS
@@ -0,0 +1,612 @@
+/* churn.c
+ *
+ * Copyright 2019 Christian Kellner
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "churn.h"
+#include "call.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/* Requesters toggle the registration of targets, which are
+ * child processes of ours, with the *ByPID methods. What the
+ * daemon should answer is kept in one word per target:
+ *
+ *   seq << 2 | busy << 1 | registered
+ *
+ * A requester owns a target while busy is set; on release it
+ * bumps the sequence number. The checker only compares answers
+ * for which the word was idle and unchanged around the query. */
+#define TARGET_REGISTERED (1 << 0)
+#define TARGET_BUSY       (1 << 1)
+#define TARGET_SEQ_SHIFT  2
+
+typedef struct ChurnTarget_
+{
+  pid_t    pid;
+  guint64  state;
+  gint64   settled;  /* when the last change was answered */
+
+  /* only touched by the checker */
+  gboolean stale;
+  guint64  stale_seq;
+} ChurnTarget;
+
+typedef struct ChurnThread_
+{
+  GmtChurn     *churn;
+  GThread      *thread;
+  GmtChurnStats stats;
+} ChurnThread;
+
+struct GmtChurn_
+{
+  char         *address;
+  guint         n_requesters;
+  guint         n_targets;
+
+  ChurnTarget  *targets;
+  int           keepalive; /* write end of the targets' pipe */
+
+  /* requesters, then the checker */
+  ChurnThread  *threads;
+  guint         n_threads;
+
+  /* run state */
+  GTask        *task;
+  GCancellable *cancellable;
+  gint64        started;
+  gint64        deadline;
+  gint          running;
+  GError       *error;
+
+  GmtChurnStats stats;
+};
+
+/* targets */
+static void
+close_fds_except (int keep)
+{
+  long max;
+
+#ifdef SYS_close_range
+  if ((keep == 0 || syscall (SYS_close_range, 0, keep - 1, 0) == 0) &&
+      syscall (SYS_close_range, keep + 1, ~0U, 0) == 0)
+    return;
+#endif
+
+  max = sysconf (_SC_OPEN_MAX);
+
+  for (int fd = 0; fd < max; fd++)
+    if (fd != keep)
+      close (fd);
+}
+
+static pid_t
+target_spawn (int fds[2])
+{
+  pid_t pid;
+  char c;
+
+  pid = fork ();
+
+  if (pid != 0)
+    return pid;
+
+  /* child: wait until the pipe is closed; everything else
+   * is closed, so that targets do not keep the pipes of
+   * other churns, or any of our connections, open */
+  close_fds_except (fds[0]);
+
+  while (read (fds[0], &c, 1) < 0 && errno == EINTR)
+    ;
+
+  _exit (0);
+}
+
+static gboolean
+targets_spawn (GmtChurn *churn,
+               GError  **error)
+{
+  int fds[2];
+
+  if (pipe2 (fds, O_CLOEXEC) < 0)
+    {
+      int err = errno;
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (err),
+                   "could not create pipe: %s", g_strerror (err));
+      return FALSE;
+    }
+
+  churn->keepalive = fds[1];
+
+  for (guint i = 0; i < churn->n_targets; i++)
+    {
+      pid_t pid = target_spawn (fds);
+
+      if (pid < 0)
+        {
+          int err = errno;
+          g_set_error (error, G_IO_ERROR, g_io_error_from_errno (err),
+                       "could not start target: %s", g_strerror (err));
+          close (fds[0]);
+          return FALSE;
+        }
+
+      churn->targets[i].pid = pid;
+    }
+
+  close (fds[0]);
+
+  return TRUE;
+}
+
+static void
+targets_reap (GmtChurn *churn)
+{
+  if (churn->keepalive > -1)
+    close (churn->keepalive);
+
+  churn->keepalive = -1;
+
+  /* do not rely on the pipe alone: a process forked
+   * elsewhere could still hold its write end */
+  for (guint i = 0; i < churn->n_targets; i++)
+    if (churn->targets[i].pid > 0)
+      kill (churn->targets[i].pid, SIGKILL);
+
+  for (guint i = 0; i < churn->n_targets; i++)
+    {
+      pid_t pid = churn->targets[i].pid;
+
+      if (pid < 1)
+        continue;
+
+      while (waitpid (pid, NULL, 0) < 0 && errno == EINTR)
+        ;
+
+      churn->targets[i].pid = 0;
+    }
+}
+
+/* calls */
+static GDBusConnection *
+churn_connect (GmtChurn *churn)
+{
+  g_autoptr(GError) err = NULL;
+  GDBusConnection *bus;
+  GDBusConnectionFlags flags;
+
+  flags = G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT |
+          G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION;
+
+  /* a connection of its own, like a separate launcher */
+  bus = g_dbus_connection_new_for_address_sync (churn->address,
+                                                flags,
+                                                NULL,
+                                                churn->cancellable,
+                                                &err);
+
+  /* the first error is kept for the task */
+  if (bus == NULL && g_atomic_pointer_compare_and_exchange (&churn->error, NULL, err))
+    err = NULL;
+
+  return bus;
+}
+
+static int
+churn_call (GDBusConnection *bus,
+            const char      *method,
+            gint32           requester,
+            gint32           target,
+            GError         **error)
+{
+  g_autoptr(GVariant) val = NULL;
+  int r = -1;
+
+  val = g_dbus_connection_call_sync (bus,
+                                     GAMEMODE_DBUS_NAME,
+                                     GAMEMODE_DBUS_PATH,
+                                     GAMEMODE_DBUS_IFACE,
+                                     method,
+                                     g_variant_new ("(ii)", requester, target),
+                                     G_VARIANT_TYPE ("(i)"),
+                                     G_DBUS_CALL_FLAGS_NONE,
+                                     -1,
+                                     NULL,
+                                     error);
+
+  if (val != NULL)
+    g_variant_get (val, "(i)", &r);
+
+  return r;
+}
+
+static gboolean
+churn_continue (GmtChurn *churn)
+{
+  return !g_cancellable_is_cancelled (churn->cancellable) &&
+         g_get_monotonic_time () < churn->deadline;
+}
+
+static void
+churn_stats_add (GmtChurnStats       *to,
+                 const GmtChurnStats *from)
+{
+  to->transitions += from->transitions;
+  to->unexpected += from->unexpected;
+  to->rejected += from->rejected;
+  to->contended += from->contended;
+  to->checks += from->checks;
+  to->ambiguous += from->ambiguous;
+  to->stale += from->stale;
+  to->windows += from->windows;
+  to->unresolved += from->unresolved;
+  to->window_max = MAX (to->window_max, from->window_max);
+  to->window_sum += from->window_sum;
+  to->errors += from->errors;
+}
+
+static void
+churn_thread_done (ChurnThread *t)
+{
+  GmtChurn *churn = t->churn;
+  GTask *task;
+
+  /* the last thread out reports back */
+  if (!g_atomic_int_dec_and_test (&churn->running))
+    return;
+
+  memset (&churn->stats, 0, sizeof (GmtChurnStats));
+
+  for (guint i = 0; i < churn->n_threads; i++)
+    churn_stats_add (&churn->stats, &churn->threads[i].stats);
+
+  churn->stats.duration = g_get_monotonic_time () - churn->started;
+
+  task = g_steal_pointer (&churn->task);
+
+  if (churn->error)
+    g_task_return_error (task, g_steal_pointer (&churn->error));
+  else
+    g_task_return_boolean (task, TRUE);
+
+  g_object_unref (task);
+}
+
+static gpointer
+churn_requester (gpointer user_data)
+{
+  g_autoptr(GDBusConnection) bus = NULL;
+  g_autoptr(GRand) rand = NULL;
+  ChurnThread *t = user_data;
+  GmtChurn *churn = t->churn;
+  gint32 self = (gint32) getpid ();
+
+  bus = churn_connect (churn);
+  rand = g_rand_new ();
+
+  while (bus && churn_continue (churn))
+    {
+      g_autoptr(GError) err = NULL;
+      ChurnTarget *target;
+      gboolean registered;
+      guint64 state;
+      guint64 seq;
+      int r;
+
+      target = &churn->targets[g_rand_int_range (rand, 0, (gint32) churn->n_targets)];
+      state = __atomic_load_n (&target->state, __ATOMIC_ACQUIRE);
+
+      if ((state & TARGET_BUSY) ||
+          !__atomic_compare_exchange_n (&target->state, &state, state | TARGET_BUSY,
+                                        FALSE, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        {
+          t->stats.contended++;
+          continue;
+        }
+
+      registered = (state & TARGET_REGISTERED) != 0;
+      seq = state >> TARGET_SEQ_SHIFT;
+
+      r = churn_call (bus,
+                      registered ? "UnregisterGameByPID" : "RegisterGameByPID",
+                      self, target->pid, &err);
+
+      if (err)
+        {
+          g_debug ("churn: call failed: %s", err->message);
+          t->stats.errors++;
+        }
+      else if (r == -2)
+        {
+          t->stats.rejected++;
+        }
+      else
+        {
+          /* either way, the daemon now agrees with the toggle */
+          if (r != 0)
+            t->stats.unexpected++;
+
+          registered = !registered;
+          t->stats.transitions++;
+        }
+
+      state = ((seq + 1) << TARGET_SEQ_SHIFT) | (registered ? TARGET_REGISTERED : 0);
+
+      __atomic_store_n (&target->settled, g_get_monotonic_time (), __ATOMIC_RELAXED);
+      __atomic_store_n (&target->state, state, __ATOMIC_RELEASE);
+    }
+
+  churn_thread_done (t);
+
+  return NULL;
+}
+
+static void
+checker_compare (ChurnThread *t,
+                 ChurnTarget *target,
+                 guint64      state,
+                 gboolean     seen,
+                 gint64       now)
+{
+  gboolean expected = (state & TARGET_REGISTERED) != 0;
+  guint64 seq = state >> TARGET_SEQ_SHIFT;
+
+  /* changed again before we saw the daemon catch up */
+  if (target->stale && target->stale_seq != seq)
+    {
+      t->stats.unresolved++;
+      target->stale = FALSE;
+    }
+
+  if (seen != expected)
+    {
+      t->stats.stale++;
+
+      if (!target->stale)
+        {
+          target->stale = TRUE;
+          target->stale_seq = seq;
+        }
+    }
+  else if (target->stale)
+    {
+      gint64 window = now - __atomic_load_n (&target->settled, __ATOMIC_RELAXED);
+
+      t->stats.windows++;
+      t->stats.window_sum += window;
+      t->stats.window_max = MAX (t->stats.window_max, window);
+      target->stale = FALSE;
+    }
+}
+
+static gpointer
+churn_checker (gpointer user_data)
+{
+  g_autoptr(GDBusConnection) bus = NULL;
+  ChurnThread *t = user_data;
+  GmtChurn *churn = t->churn;
+  gint32 self = (gint32) getpid ();
+
+  bus = churn_connect (churn);
+
+  for (guint i = 0; bus && churn_continue (churn); i = (i + 1) % churn->n_targets)
+    {
+      g_autoptr(GError) err = NULL;
+      ChurnTarget *target = &churn->targets[i];
+      guint64 before, after;
+      int r;
+
+      before = __atomic_load_n (&target->state, __ATOMIC_ACQUIRE);
+
+      if (before & TARGET_BUSY)
+        {
+          g_thread_yield ();
+          continue;
+        }
+
+      r = churn_call (bus, "QueryStatusByPID", self, target->pid, &err);
+      after = __atomic_load_n (&target->state, __ATOMIC_ACQUIRE);
+
+      if (err)
+        {
+          g_debug ("churn: query failed: %s", err->message);
+          t->stats.errors++;
+          continue;
+        }
+
+      t->stats.checks++;
+
+      if (before != after)
+        {
+          t->stats.ambiguous++;
+          continue;
+        }
+
+      checker_compare (t, target, before, r == 2, g_get_monotonic_time ());
+    }
+
+  churn_thread_done (t);
+
+  return NULL;
+}
+
+/* public */
+GmtChurn *
+gmt_churn_new (const char *address,
+               guint       n_requesters,
+               guint       n_targets,
+               GError    **error)
+{
+  g_autofree char *addr = NULL;
+  GmtChurn *churn;
+
+  g_return_val_if_fail (n_requesters > 0, NULL);
+  g_return_val_if_fail (n_targets > 0, NULL);
+
+  if (address == NULL)
+    addr = g_dbus_address_get_for_bus_sync (G_BUS_TYPE_SESSION, NULL, error);
+  else
+    addr = g_strdup (address);
+
+  if (addr == NULL)
+    return NULL;
+
+  churn = g_slice_new0 (GmtChurn);
+  churn->address = g_steal_pointer (&addr);
+  churn->n_requesters = n_requesters;
+  churn->n_targets = n_targets;
+  churn->targets = g_new0 (ChurnTarget, n_targets);
+  churn->keepalive = -1;
+  churn->n_threads = n_requesters + 1;
+  churn->threads = g_new0 (ChurnThread, churn->n_threads);
+
+  for (guint i = 0; i < churn->n_threads; i++)
+    churn->threads[i].churn = churn;
+
+  if (!targets_spawn (churn, error))
+    {
+      gmt_churn_free (churn);
+      return NULL;
+    }
+
+  return churn;
+}
+
+void
+gmt_churn_free (GmtChurn *churn)
+{
+  if (churn == NULL)
+    return;
+
+  if (churn->cancellable)
+    g_cancellable_cancel (churn->cancellable);
+
+  for (guint i = 0; i < churn->n_threads; i++)
+    if (churn->threads[i].thread)
+      g_thread_join (churn->threads[i].thread);
+
+  targets_reap (churn);
+
+  g_clear_error (&churn->error);
+  g_clear_object (&churn->cancellable);
+  g_free (churn->threads);
+  g_free (churn->targets);
+  g_free (churn->address);
+  g_slice_free (GmtChurn, churn);
+}
+
+void
+gmt_churn_run_async (GmtChurn           *churn,
+                     guint               seconds,
+                     gpointer            source_object,
+                     GCancellable       *cancellable,
+                     GAsyncReadyCallback callback,
+                     gpointer            user_data)
+{
+  g_return_if_fail (churn->task == NULL);
+  g_return_if_fail (churn->cancellable == NULL);
+
+  churn->task = g_task_new (source_object, cancellable, callback, user_data);
+  churn->cancellable = cancellable ? g_object_ref (cancellable) : g_cancellable_new ();
+  churn->running = (gint) churn->n_threads;
+  churn->started = g_get_monotonic_time ();
+  churn->deadline = churn->started + (gint64) seconds * G_USEC_PER_SEC;
+
+  g_debug ("churn: %u requesters, %u targets, %u s",
+           churn->n_requesters, churn->n_targets, seconds);
+
+  for (guint i = 0; i < churn->n_threads; i++)
+    {
+      ChurnThread *t = &churn->threads[i];
+      g_autofree char *name = NULL;
+
+      if (i < churn->n_requesters)
+        {
+          name = g_strdup_printf ("gmt-churn-%u", i);
+          t->thread = g_thread_new (name, churn_requester, t);
+        }
+      else
+        {
+          t->thread = g_thread_new ("gmt-churn-check", churn_checker, t);
+        }
+    }
+}
+
+gboolean
+gmt_churn_run_finish (GmtChurn     *churn,
+                      GAsyncResult *res,
+                      GError      **error)
+{
+  g_return_val_if_fail (g_task_is_valid (res, NULL), FALSE);
+
+  return g_task_propagate_boolean (G_TASK (res), error);
+}
+
+void
+gmt_churn_get_stats (GmtChurn      *churn,
+                     GmtChurnStats *stats)
+{
+  *stats = churn->stats;
+}
+
+char *
+gmt_churn_format (GmtChurn *churn)
+{
+  const GmtChurnStats *s = &churn->stats;
+  double secs = s->duration / (double) G_USEC_PER_SEC;
+  GString *str;
+
+  if (secs <= 0)
+    secs = 1;
+
+  str = g_string_new (NULL);
+
+  g_string_append_printf (str, "%u requesters, %u targets, %.1f s\n",
+                          churn->n_requesters, churn->n_targets, secs);
+
+  g_string_append_printf (str, "transitions %9" G_GUINT64_FORMAT " %9.1f/s"
+                          "  unexpected %" G_GUINT64_FORMAT
+                          ", rejected %" G_GUINT64_FORMAT
+                          ", contended %" G_GUINT64_FORMAT "\n",
+                          s->transitions, s->transitions / secs,
+                          s->unexpected, s->rejected, s->contended);
+
+  g_string_append_printf (str, "checks      %9" G_GUINT64_FORMAT " %9.1f/s"
+                          "  ambiguous %" G_GUINT64_FORMAT
+                          ", errors %" G_GUINT64_FORMAT "\n",
+                          s->checks, s->checks / secs,
+                          s->ambiguous, s->errors);
+
+  g_string_append_printf (str, "stale       %9" G_GUINT64_FORMAT
+                          "  windows %" G_GUINT64_FORMAT
+                          " (max %" G_GINT64_FORMAT " us, mean %.1f us)"
+                          ", unresolved %" G_GUINT64_FORMAT,
+                          s->stale, s->windows, s->window_max,
+                          s->windows ? s->window_sum / (double) s->windows : 0.0,
+                          s->unresolved);
+
+  return g_string_free (str, FALSE);
+}
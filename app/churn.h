@@ -0,0 +1,71 @@
+/* churn.h
+ *
+ * Copyright 2019 Christian Kellner
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+typedef struct GmtChurnStats_
+{
+  /* requesters */
+  guint64 transitions; /* register/unregister calls answered */
+  guint64 unexpected;  /* answers that disagreed with the record */
+  guint64 rejected;    /* answered with -2 */
+  guint64 contended;   /* picked a target busy in another requester */
+
+  /* checker */
+  guint64 checks;      /* QueryStatusByPID answers compared */
+  guint64 ambiguous;   /* target changed while the query was out */
+  guint64 stale;       /* answers disagreeing with the record */
+  guint64 windows;     /* stale periods that ended in agreement */
+  guint64 unresolved;  /* stale periods ended by the next change */
+  gint64  window_max;  /* usec */
+  gint64  window_sum;  /* usec */
+
+  guint64 errors;      /* calls that failed on either side */
+  gint64  duration;    /* usec */
+} GmtChurnStats;
+
+typedef struct GmtChurn_ GmtChurn;
+
+GmtChurn * gmt_churn_new (const char *address,
+                          guint       n_requesters,
+                          guint       n_targets,
+                          GError    **error);
+
+void       gmt_churn_free (GmtChurn *churn);
+
+void       gmt_churn_run_async (GmtChurn           *churn,
+                                guint               seconds,
+                                gpointer            source_object,
+                                GCancellable       *cancellable,
+                                GAsyncReadyCallback callback,
+                                gpointer            user_data);
+
+gboolean   gmt_churn_run_finish (GmtChurn     *churn,
+                                 GAsyncResult *res,
+                                 GError      **error);
+
+void       gmt_churn_get_stats (GmtChurn      *churn,
+                                GmtChurnStats *stats);
+
+char     * gmt_churn_format (GmtChurn *churn);
+
+G_END_DECLS
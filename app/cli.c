@@ -0,0 +1,903 @@
+/* cli.c
+ *
+ * Copyright 2019 Christian Kellner
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#ifdef HAVE_ALLOC_COUNTER
+#include "allocs.h"
+#endif
+#include "bench.h"
+#include "call.h"
+#include "churn.h"
+#include "libworker.h"
+#include "startup.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/* exit code for "skipped", as understood by meson */
+#define EXIT_SKIP 77
+
+typedef struct CheckStep_
+{
+  const char   *method;
+  GmtLibRequest request;
+  int           expect;
+  gboolean      self; /* ask about this process, not the target */
+} CheckStep;
+
+/* Expected answers of a freshly started daemon, with
+ * target and requester both being this process. */
+static const CheckStep check_calls[] = {
+  {"QueryStatus",    0,  0},
+  {"RegisterGame",   0,  0},
+  {"QueryStatus",    0,  2},
+  {"RegisterGame",   0, -1},
+  {"UnregisterGame", 0,  0},
+  {"UnregisterGame", 0, -1},
+  {"QueryStatus",    0,  0},
+  {NULL, 0, 0},
+};
+
+/* With a child as the target, asking about ourselves
+ * tells whether the target and requester got swapped. */
+static const CheckStep check_calls_child[] = {
+  {"QueryStatus",    0,  0},
+  {"RegisterGame",   0,  0},
+  {"QueryStatus",    0,  2},
+  {"QueryStatus",    0,  1, TRUE},
+  {"RegisterGame",   0, -1},
+  {"UnregisterGame", 0,  0},
+  {"UnregisterGame", 0, -1},
+  {"QueryStatus",    0,  0},
+  {NULL, 0, 0},
+};
+
+static const CheckStep check_library[] = {
+  {"gamemode_query_status",  GMT_LIB_REQUEST_QUERY, 0},
+  {"gamemode_request_start", GMT_LIB_REQUEST_START, 0},
+  {"gamemode_query_status",  GMT_LIB_REQUEST_QUERY, 2},
+  {"gamemode_request_end",   GMT_LIB_REQUEST_END,   0},
+  {"gamemode_query_status",  GMT_LIB_REQUEST_QUERY, 0},
+  {NULL, 0, 0},
+};
+
+typedef struct Cli_
+{
+  GMainLoop       *loop;
+  int              status;
+
+  /* options */
+  gboolean         portal;
+  gboolean         steady;
+  gboolean         child;
+  gboolean         json;
+  gint             iterations;
+  gint             requesters;
+  gint             targets;
+  gint             duration;
+  char           **addresses;
+
+  gint32           pid;
+  gint32           target;
+
+  /* check */
+  const CheckStep *steps;
+  GmtCallArgs      args;
+  guint            step;
+  const char      *method;
+  int              pidfd;
+  int              target_pidfd;
+  GDBusConnection *bus; /* NULL: session bus */
+  GmtCallPool     *pool;
+  GmtLibWorker    *lib;
+
+  /* bench, churn */
+  GPtrArray       *buses;
+  guint            pending;
+} Cli;
+
+static void
+cli_quit (Cli *cli,
+          int  status)
+{
+  if (status != EXIT_SUCCESS)
+    cli->status = status;
+
+  g_main_loop_quit (cli->loop);
+}
+
+/* check */
+static void check_next (Cli *cli);
+
+static void
+check_result (Cli          *cli,
+              const char   *name,
+              int           r,
+              const GError *error)
+{
+  const CheckStep *s = &cli->steps[cli->step];
+
+  if (error != NULL)
+    {
+      g_print ("%-24s error: %s  FAIL\n", name, error->message);
+      cli->status = EXIT_FAILURE;
+    }
+  else if (r != s->expect)
+    {
+      g_print ("%-24s %3d, expected %d  FAIL\n", name, r, s->expect);
+      cli->status = EXIT_FAILURE;
+    }
+  else
+    {
+      g_print ("%-24s %3d  ok\n", name, r);
+    }
+
+  cli->step++;
+  check_next (cli);
+}
+
+static void
+on_check_call_ready (GObject      *source,
+                     GAsyncResult *res,
+                     gpointer      user_data)
+{
+  g_autoptr(GError) err = NULL;
+  Cli *cli = user_data;
+  int r;
+
+  r = gmt_call_gamemode_finish (res, &err);
+
+  /* GameMode's own error codes are what we check for */
+  if (err && err->domain == GMT_CALL_ERROR)
+    g_clear_error (&err);
+
+  check_result (cli, cli->method, r, err);
+}
+
+static void
+on_check_pool_ready (int           result,
+                     const GError *error,
+                     gpointer      user_data)
+{
+  Cli *cli = user_data;
+
+  check_result (cli, cli->method, result, error);
+}
+
+static void
+on_check_library_ready (GObject      *source,
+                        GAsyncResult *res,
+                        gpointer      user_data)
+{
+  g_autoptr(GError) err = NULL;
+  Cli *cli = user_data;
+  GmtLibResult result = { 0, };
+
+  gmt_lib_worker_request_finish (res, &result, &err);
+
+  check_result (cli, cli->steps[cli->step].method, result.result, err);
+}
+
+static void
+check_next (Cli *cli)
+{
+  g_autoptr(GUnixFDList) fds = NULL;
+  g_autoptr(GError) err = NULL;
+  const CheckStep *s = &cli->steps[cli->step];
+  GVariant *params = NULL;
+  gint32 target;
+  int target_fd;
+
+  if (s->method == NULL)
+    {
+      cli_quit (cli, EXIT_SUCCESS);
+      return;
+    }
+
+  if (cli->lib)
+    {
+      gmt_lib_worker_request_async (cli->lib, s->request, NULL,
+                                    on_check_library_ready, cli);
+      return;
+    }
+
+  cli->method = gmt_call_method (s->method, cli->args, cli->portal);
+
+  target = s->self ? cli->pid : cli->target;
+  target_fd = s->self ? cli->pidfd : cli->target_pidfd;
+
+  if (cli->pool)
+    {
+      gmt_call_pool_call (cli->pool,
+                          s->method,
+                          cli->args,
+                          target,
+                          cli->pid,
+                          on_check_pool_ready,
+                          cli);
+      return;
+    }
+
+  params = gmt_call_params (s->method, cli->args, cli->portal,
+                            target, cli->pid, target_fd, cli->pidfd,
+                            NULL, &fds, &err);
+
+  if (params == NULL)
+    {
+      check_result (cli, cli->method, -1, err);
+      return;
+    }
+
+  gmt_call_gamemode (NULL,
+                     cli->bus,
+                     cli->method,
+                     params,
+                     fds,
+                     cli->portal,
+                     on_check_call_ready,
+                     cli);
+}
+
+/* a game that is not the requester; it dies with us */
+static pid_t
+check_target_spawn (void)
+{
+  pid_t pid;
+
+  pid = fork ();
+
+  if (pid != 0)
+    return pid;
+
+  prctl (PR_SET_PDEATHSIG, SIGKILL);
+
+  for (;;)
+    pause ();
+}
+
+static int
+cli_check (Cli        *cli,
+           const char *path)
+{
+  g_autoptr(GError) err = NULL;
+  guint n_addresses;
+
+  n_addresses = cli->addresses ? g_strv_length (cli->addresses) : 0;
+
+  if (n_addresses > 1)
+    {
+      g_printerr ("check runs against a single bus, got %u addresses\n", n_addresses);
+      return EXIT_FAILURE;
+    }
+
+  /* libgamemode finds its bus via DBUS_SESSION_BUS_ADDRESS */
+  if (n_addresses > 0 && g_str_equal (path, "library"))
+    {
+      g_printerr ("library checks always use the session bus\n");
+      return EXIT_FAILURE;
+    }
+
+  cli->steps = check_calls;
+  cli->target = cli->pid;
+
+  if (cli->child && !g_str_equal (path, "library"))
+    {
+      pid_t pid = check_target_spawn ();
+
+      if (pid < 0)
+        {
+          g_printerr ("could not start target: %s\n", g_strerror (errno));
+          return EXIT_FAILURE;
+        }
+
+      cli->target = (gint32) pid;
+      cli->steps = check_calls_child;
+    }
+
+  if (g_str_equal (path, "builtin"))
+    {
+      cli->args = GMT_CALL_ARGS_PID;
+    }
+  else if (g_str_equal (path, "by-pid"))
+    {
+      cli->args = GMT_CALL_ARGS_PID_PAIR;
+    }
+  else if (g_str_equal (path, "by-pidfd"))
+    {
+      cli->args = GMT_CALL_ARGS_PIDFD_PAIR;
+      cli->pidfd = gmt_pidfd_open (cli->pid, &err);
+
+      if (cli->pidfd > -1)
+        cli->target_pidfd = gmt_pidfd_open (cli->target, &err);
+
+      if (cli->pidfd < 0 || cli->target_pidfd < 0)
+        {
+          g_printerr ("skipping: %s\n", err->message);
+          return EXIT_SKIP;
+        }
+    }
+  else if (g_str_equal (path, "library"))
+    {
+      cli->steps = check_library;
+      cli->lib = gmt_lib_worker_new ();
+    }
+  else
+    {
+      g_printerr ("unknown call path: %s\n", path);
+      return EXIT_FAILURE;
+    }
+
+  if (n_addresses > 0)
+    {
+      GDBusConnectionFlags flags;
+
+      flags = G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT |
+              G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION;
+
+      cli->bus = g_dbus_connection_new_for_address_sync (cli->addresses[0], flags,
+                                                         NULL, NULL, &err);
+    }
+  else if (cli->steady && cli->lib == NULL)
+    {
+      cli->bus = g_bus_get_sync (G_BUS_TYPE_SESSION, NULL, &err);
+    }
+
+  if (err != NULL)
+    {
+      g_printerr ("could not connect to the bus: %s\n", err->message);
+      return EXIT_FAILURE;
+    }
+
+  if (cli->steady && cli->lib == NULL)
+    cli->pool = gmt_call_pool_new (cli->bus, cli->portal);
+
+  check_next (cli);
+  g_main_loop_run (cli->loop);
+
+  return cli->status;
+}
+
+/* buses: bench and churn run on each in parallel */
+typedef struct CliBus_
+{
+  Cli             *cli;
+  guint            index;
+  const char      *address; /* NULL: session bus */
+
+  GmtBench        *bench;
+  GmtChurn        *churn;
+  gboolean         failed;
+} CliBus;
+
+static void
+cli_bus_free (gpointer data)
+{
+  CliBus *b = data;
+
+  g_clear_pointer (&b->bench, gmt_bench_free);
+  g_clear_pointer (&b->churn, gmt_churn_free);
+  g_slice_free (CliBus, b);
+}
+
+static void
+cli_buses_new (Cli *cli)
+{
+  guint n = cli->addresses ? g_strv_length (cli->addresses) : 0;
+
+  cli->buses = g_ptr_array_new_with_free_func (cli_bus_free);
+
+  for (guint i = 0; i < MAX (n, 1); i++)
+    {
+      CliBus *b = g_slice_new0 (CliBus);
+
+      b->cli = cli;
+      b->index = i;
+      b->address = n > 0 ? cli->addresses[i] : NULL;
+
+      g_ptr_array_add (cli->buses, b);
+    }
+
+  cli->pending = cli->buses->len;
+}
+
+/* quoted JSON string; bytes that are not UTF-8 cannot be
+ * represented, they become U+FFFD */
+static void
+json_append_string (GString    *str,
+                    const char *s)
+{
+  const char *end = s + strlen (s);
+
+  g_string_append_c (str, '"');
+
+  while (s < end)
+    {
+      gunichar c = g_utf8_get_char_validated (s, end - s);
+
+      if (c == (gunichar) -1 || c == (gunichar) -2)
+        {
+          g_string_append (str, "\\ufffd");
+          s++;
+          continue;
+        }
+
+      if (c == '"' || c == '\\')
+        {
+          g_string_append_c (str, '\\');
+          g_string_append_c (str, (char) c);
+        }
+      else if (c < 0x20)
+        {
+          g_string_append_printf (str, "\\u%04x", c);
+        }
+      else
+        {
+          g_string_append_len (str, s, g_utf8_next_char (s) - s);
+        }
+
+      s = g_utf8_next_char (s);
+    }
+
+  g_string_append_c (str, '"');
+}
+
+static char *
+cli_bus_json (CliBus *b)
+{
+  GString *str;
+
+  str = g_string_new (NULL);
+  g_string_append_printf (str, "\"bus\": %u, \"address\": ", b->index);
+  json_append_string (str, b->address ? b->address : "session");
+
+  return g_string_free (str, FALSE);
+}
+
+static void
+cli_bus_print_header (CliBus *b)
+{
+  if (b->cli->buses->len > 1 || b->address)
+    g_print ("bus %u: %s\n", b->index, b->address ? b->address : "session");
+}
+
+/* bench */
+static void
+bench_print_json (CliBus *b)
+{
+  g_autofree char *bus = cli_bus_json (b);
+  const char *mode = b->cli->steady ? "steady" : "regular";
+  const char *pidfd_error;
+  char allocs[32] = "null";
+  guint errors = 0;
+  gint64 duration;
+  double per_call;
+  guint calls;
+
+  for (guint i = 0; i < gmt_bench_get_n_methods (b->bench); i++)
+    {
+      GmtBenchStats stats;
+
+      if (!gmt_bench_get_stats (b->bench, i, &stats))
+        continue;
+
+      errors += stats.errors;
+
+      g_print ("{%s, \"mode\": \"%s\", \"method\": \"%s\", \"n\": %u, \"errors\": %u, "
+               "\"min_us\": %" G_GINT64_FORMAT ", \"p50_us\": %" G_GINT64_FORMAT ", "
+               "\"p90_us\": %" G_GINT64_FORMAT ", \"p99_us\": %" G_GINT64_FORMAT ", "
+               "\"max_us\": %" G_GINT64_FORMAT ", \"mean_us\": %.1f}\n",
+               bus, mode, stats.method, stats.n, stats.errors,
+               stats.min, stats.p50, stats.p90, stats.p99, stats.max,
+               stats.mean);
+    }
+
+  calls = gmt_bench_get_n_calls (b->bench);
+  duration = gmt_bench_get_duration (b->bench);
+  pidfd_error = gmt_bench_get_pidfd_error (b->bench);
+  per_call = gmt_bench_get_allocs_per_call (b->bench);
+
+  if (per_call >= 0)
+    g_ascii_formatd (allocs, sizeof (allocs), "%.2f", per_call);
+
+  g_print ("{%s, \"mode\": \"%s\", \"method\": \"total\", \"calls\": %u, \"errors\": %u, "
+           "\"duration_us\": %" G_GINT64_FORMAT ", \"calls_per_s\": %.1f, "
+           "\"allocs_per_call\": %s, \"pidfd\": %s}\n",
+           bus, mode, calls, errors, duration,
+           duration > 0 ? calls * (double) G_USEC_PER_SEC / duration : 0.0,
+           allocs,
+           pidfd_error ? "false" : "true");
+}
+
+static guint
+bench_count_errors (GmtBench *bench)
+{
+  guint errors = 0;
+
+  for (guint i = 0; i < gmt_bench_get_n_methods (bench); i++)
+    {
+      GmtBenchStats stats;
+
+      gmt_bench_get_stats (bench, i, &stats);
+      errors += stats.errors;
+    }
+
+  return errors;
+}
+
+static void
+bench_report (Cli *cli)
+{
+  gint64 duration = 0;
+  guint calls = 0;
+  gboolean failed = FALSE;
+
+  for (guint i = 0; i < cli->buses->len; i++)
+    {
+      CliBus *b = g_ptr_array_index (cli->buses, i);
+
+      failed |= b->failed;
+
+      if (b->failed)
+        continue;
+
+      if (cli->json)
+        {
+          bench_print_json (b);
+        }
+      else
+        {
+          g_autofree char *txt = gmt_bench_format (b->bench);
+          cli_bus_print_header (b);
+          g_print ("%s\n", txt);
+        }
+
+      /* the buses ran side by side */
+      calls += gmt_bench_get_n_calls (b->bench);
+      duration = MAX (duration, gmt_bench_get_duration (b->bench));
+      failed |= bench_count_errors (b->bench) > 0;
+    }
+
+  if (cli->buses->len > 1)
+    {
+      double rate = duration > 0 ? calls * (double) G_USEC_PER_SEC / duration : 0.0;
+
+      if (cli->json)
+        g_print ("{\"bus\": \"all\", \"buses\": %u, \"calls\": %u, "
+                 "\"duration_us\": %" G_GINT64_FORMAT ", \"calls_per_s\": %.1f}\n",
+                 cli->buses->len, calls, duration, rate);
+      else
+        g_print ("all %u buses: %u calls, %.1f calls/s\n",
+                 cli->buses->len, calls, rate);
+    }
+
+  cli_quit (cli, failed ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+static void
+on_bench_ready (GObject      *source,
+                GAsyncResult *res,
+                gpointer      user_data)
+{
+  g_autoptr(GError) err = NULL;
+  CliBus *b = user_data;
+  Cli *cli = b->cli;
+
+  if (!gmt_bench_run_finish (b->bench, res, &err))
+    {
+      g_printerr ("bus %u: benchmark failed: %s\n", b->index, err->message);
+      b->failed = TRUE;
+    }
+
+  if (--cli->pending == 0)
+    bench_report (cli);
+}
+
+static void
+bench_start (CliBus          *b,
+             GDBusConnection *bus,
+             const GError    *error)
+{
+  Cli *cli = b->cli;
+
+  if (bus == NULL)
+    {
+      g_printerr ("bus %u: could not connect: %s\n", b->index, error->message);
+      b->failed = TRUE;
+
+      if (--cli->pending == 0)
+        bench_report (cli);
+
+      return;
+    }
+
+  b->bench = gmt_bench_new (cli->iterations,
+                            cli->pid,
+                            cli->pid,
+                            cli->portal,
+                            cli->steady);
+
+  gmt_bench_set_connection (b->bench, bus);
+#ifdef HAVE_ALLOC_COUNTER
+  gmt_bench_set_alloc_counter (b->bench, gmt_allocs_get);
+#endif
+  gmt_bench_run_async (b->bench, NULL, NULL, on_bench_ready, b);
+}
+
+static void
+on_bench_address_ready (GObject      *source,
+                        GAsyncResult *res,
+                        gpointer      user_data)
+{
+  g_autoptr(GDBusConnection) bus = NULL;
+  g_autoptr(GError) err = NULL;
+
+  bus = g_dbus_connection_new_for_address_finish (res, &err);
+  bench_start (user_data, bus, err);
+}
+
+static void
+on_bench_session_ready (GObject      *source,
+                        GAsyncResult *res,
+                        gpointer      user_data)
+{
+  g_autoptr(GDBusConnection) bus = NULL;
+  g_autoptr(GError) err = NULL;
+
+  bus = g_bus_get_finish (res, &err);
+  bench_start (user_data, bus, err);
+}
+
+static int
+cli_bench (Cli *cli)
+{
+  GDBusConnectionFlags flags;
+
+  if (cli->iterations < 1)
+    {
+      g_printerr ("invalid number of iterations: %d\n", cli->iterations);
+      return EXIT_FAILURE;
+    }
+
+  flags = G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT |
+          G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION;
+
+  cli_buses_new (cli);
+
+  for (guint i = 0; i < cli->buses->len; i++)
+    {
+      CliBus *b = g_ptr_array_index (cli->buses, i);
+
+      if (b->address)
+        g_dbus_connection_new_for_address (b->address, flags, NULL, NULL,
+                                           on_bench_address_ready, b);
+      else
+        g_bus_get (G_BUS_TYPE_SESSION, NULL, on_bench_session_ready, b);
+    }
+
+  g_main_loop_run (cli->loop);
+
+  return cli->status;
+}
+
+/* churn */
+static void
+churn_print_json (CliBus *b)
+{
+  g_autofree char *bus = cli_bus_json (b);
+  Cli *cli = b->cli;
+  GmtChurnStats s;
+  double secs;
+
+  gmt_churn_get_stats (b->churn, &s);
+  secs = MAX (s.duration, 1) / (double) G_USEC_PER_SEC;
+
+  g_print ("{%s, \"requesters\": %d, \"targets\": %d, \"duration_us\": %" G_GINT64_FORMAT ", "
+           "\"transitions\": %" G_GUINT64_FORMAT ", \"transitions_per_s\": %.1f, "
+           "\"checks\": %" G_GUINT64_FORMAT ", \"checks_per_s\": %.1f, "
+           "\"unexpected\": %" G_GUINT64_FORMAT ", \"rejected\": %" G_GUINT64_FORMAT ", "
+           "\"contended\": %" G_GUINT64_FORMAT ", \"ambiguous\": %" G_GUINT64_FORMAT ", "
+           "\"stale\": %" G_GUINT64_FORMAT ", \"windows\": %" G_GUINT64_FORMAT ", "
+           "\"unresolved\": %" G_GUINT64_FORMAT ", \"window_max_us\": %" G_GINT64_FORMAT ", "
+           "\"window_mean_us\": %.1f, \"errors\": %" G_GUINT64_FORMAT "}\n",
+           bus, cli->requesters, cli->targets, s.duration,
+           s.transitions, s.transitions / secs,
+           s.checks, s.checks / secs,
+           s.unexpected, s.rejected, s.contended, s.ambiguous,
+           s.stale, s.windows, s.unresolved, s.window_max,
+           s.windows ? s.window_sum / (double) s.windows : 0.0,
+           s.errors);
+}
+
+static void
+churn_report (Cli *cli)
+{
+  gboolean failed = FALSE;
+
+  for (guint i = 0; i < cli->buses->len; i++)
+    {
+      CliBus *b = g_ptr_array_index (cli->buses, i);
+      GmtChurnStats s;
+
+      failed |= b->failed;
+
+      if (b->failed)
+        continue;
+
+      if (cli->json)
+        {
+          churn_print_json (b);
+        }
+      else
+        {
+          g_autofree char *txt = gmt_churn_format (b->churn);
+          cli_bus_print_header (b);
+          g_print ("%s\n", txt);
+        }
+
+      /* stale answers are what we measure, wrong codes are failures */
+      gmt_churn_get_stats (b->churn, &s);
+      failed |= s.errors > 0 || s.unexpected > 0;
+    }
+
+  cli_quit (cli, failed ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+static void
+on_churn_ready (GObject      *source,
+                GAsyncResult *res,
+                gpointer      user_data)
+{
+  g_autoptr(GError) err = NULL;
+  CliBus *b = user_data;
+  Cli *cli = b->cli;
+
+  if (!gmt_churn_run_finish (b->churn, res, &err))
+    {
+      g_printerr ("bus %u: churn failed: %s\n", b->index, err->message);
+      b->failed = TRUE;
+    }
+
+  if (--cli->pending == 0)
+    churn_report (cli);
+}
+
+static int
+cli_churn (Cli *cli)
+{
+  if (cli->requesters < 1 || cli->targets < 1 || cli->duration < 1)
+    {
+      g_printerr ("requesters, targets and duration must be positive\n");
+      return EXIT_FAILURE;
+    }
+
+  cli_buses_new (cli);
+
+  for (guint i = 0; i < cli->buses->len; i++)
+    {
+      g_autoptr(GError) err = NULL;
+      CliBus *b = g_ptr_array_index (cli->buses, i);
+
+      b->churn = gmt_churn_new (b->address, cli->requesters, cli->targets, &err);
+
+      if (b->churn == NULL)
+        {
+          g_printerr ("bus %u: could not set up churn: %s\n", b->index, err->message);
+          return EXIT_FAILURE;
+        }
+    }
+
+  for (guint i = 0; i < cli->buses->len; i++)
+    {
+      CliBus *b = g_ptr_array_index (cli->buses, i);
+
+      gmt_churn_run_async (b->churn, cli->duration, NULL, NULL, on_churn_ready, b);
+    }
+
+  g_main_loop_run (cli->loop);
+
+  return cli->status;
+}
+
+int
+main (int argc, char **argv)
+{
+  g_autoptr(GOptionContext) ctx = NULL;
+  g_autoptr(GError) err = NULL;
+  Cli cli = {
+    .iterations = 100,
+    .requesters = 4,
+    .targets = 8,
+    .duration = 5,
+    .pidfd = -1,
+    .target_pidfd = -1,
+  };
+  GOptionEntry options[] = {
+    { "portal", 0, 0, G_OPTION_ARG_NONE, &cli.portal, "Call through the portal", NULL },
+    { "steady", 0, 0, G_OPTION_ARG_NONE, &cli.steady, "Use the pooled, steady state call path", NULL },
+    { "child-target", 0, 0, G_OPTION_ARG_NONE, &cli.child, "Check with a child process as the game", NULL },
+    { "iterations", 'n', 0, G_OPTION_ARG_INT, &cli.iterations, "Benchmark iterations", "N" },
+    { "requesters", 0, 0, G_OPTION_ARG_INT, &cli.requesters, "Churn requester threads", "N" },
+    { "targets", 0, 0, G_OPTION_ARG_INT, &cli.targets, "Churn target processes", "N" },
+    { "duration", 0, 0, G_OPTION_ARG_INT, &cli.duration, "Churn duration", "SECONDS" },
+    { "address", 'a', 0, G_OPTION_ARG_STRING_ARRAY, &cli.addresses, "Bus to use instead of the session bus, repeat to bench or churn on more", "ADDRESS" },
+    { "json", 0, 0, G_OPTION_ARG_NONE, &cli.json, "Print results as JSON lines", NULL },
+    { NULL }
+  };
+  int r;
+
+  gmt_startup_init ();
+
+  ctx = g_option_context_new ("check builtin|by-pid|by-pidfd|library | bench | churn");
+  g_option_context_set_summary (ctx, "Exercise GameMode without a user interface");
+  g_option_context_add_main_entries (ctx, options, NULL);
+
+  if (!g_option_context_parse (ctx, &argc, &argv, &err))
+    {
+      g_printerr ("%s\n", err->message);
+      return EXIT_FAILURE;
+    }
+
+  cli.loop = g_main_loop_new (NULL, FALSE);
+  cli.pid = (gint32) getpid ();
+
+  if (argc == 3 && g_str_equal (argv[1], "check"))
+    {
+      r = cli_check (&cli, argv[2]);
+    }
+  else if (argc == 2 && g_str_equal (argv[1], "bench"))
+    {
+      r = cli_bench (&cli);
+    }
+  else if (argc == 2 && g_str_equal (argv[1], "churn"))
+    {
+      r = cli_churn (&cli);
+    }
+  else
+    {
+      g_autofree char *help = g_option_context_get_help (ctx, TRUE, NULL);
+      g_printerr ("%s", help);
+      r = EXIT_FAILURE;
+    }
+
+  g_clear_pointer (&cli.buses, g_ptr_array_unref);
+  g_clear_pointer (&cli.addresses, g_strfreev);
+  g_clear_pointer (&cli.pool, gmt_call_pool_free);
+  g_clear_object (&cli.bus);
+  g_clear_pointer (&cli.lib, gmt_lib_worker_free);
+  g_clear_pointer (&cli.loop, g_main_loop_unref);
+
+  if (cli.pidfd > -1)
+    close (cli.pidfd);
+
+  if (cli.target_pidfd > -1)
+    close (cli.target_pidfd);
+
+  if (cli.target > 0 && cli.target != cli.pid)
+    {
+      kill (cli.target, SIGKILL);
+      waitpid (cli.target, NULL, 0);
+    }
+
+  return r;
+}
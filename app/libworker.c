@@ -0,0 +1,254 @@
+/* libworker.c
+ *
+ * Copyright 2019 Christian Kellner
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "libworker.h"
+#include "startup.h"
+#include "gamemode_client.h"
+
+/* One pending library call and all the requests it answers */
+typedef struct LibOp_
+{
+  GmtLibRequest request;
+  GPtrArray    *tasks;
+  gboolean      merged;
+} LibOp;
+
+struct GmtLibWorker_
+{
+  GThread *thread;
+
+  GMutex   lock;
+  GCond    cond;
+  GQueue   ops;
+  gboolean quit;
+
+  /* only touched by the worker thread */
+  int      issued;      /* -1: unknown, 0: ended, 1: started */
+  int      last_switch; /* result of the last start/end call */
+};
+
+static gboolean
+request_is_switch (GmtLibRequest request)
+{
+  return request != GMT_LIB_REQUEST_QUERY;
+}
+
+static LibOp *
+lib_op_new (GmtLibRequest request)
+{
+  LibOp *op;
+
+  op = g_slice_new0 (LibOp);
+  op->request = request;
+  op->tasks = g_ptr_array_new_with_free_func (g_object_unref);
+
+  return op;
+}
+
+static void
+lib_op_free (LibOp *op)
+{
+  g_ptr_array_unref (op->tasks);
+  g_slice_free (LibOp, op);
+}
+
+static void
+lib_op_run (GmtLibWorker *worker,
+            LibOp        *op)
+{
+  gboolean skipped = FALSE;
+  gint64 start, end;
+  int want;
+  int r;
+
+  start = g_get_monotonic_time ();
+  want = op->request == GMT_LIB_REQUEST_START ? 1 : 0;
+
+  /* toggled back and forth while queued, ending up where
+   * the last call already brought us: nothing to do */
+  if (request_is_switch (op->request) && op->merged && worker->issued == want)
+    {
+      r = worker->last_switch;
+      skipped = TRUE;
+    }
+  else if (op->request == GMT_LIB_REQUEST_START)
+    {
+      r = gamemode_request_start ();
+      worker->last_switch = r;
+      worker->issued = r == 0 ? 1 : -1;
+    }
+  else if (op->request == GMT_LIB_REQUEST_END)
+    {
+      r = gamemode_request_end ();
+      worker->last_switch = r;
+      worker->issued = r != -2 ? 0 : -1;
+    }
+  else
+    {
+      r = gamemode_query_status ();
+    }
+
+  end = g_get_monotonic_time ();
+
+  /* the first call includes loading libgamemode */
+  if (!skipped)
+    gmt_startup_mark (GMT_STARTUP_LIBRARY_CALL);
+
+  for (guint i = 0; i < op->tasks->len; i++)
+    {
+      GTask *task = g_ptr_array_index (op->tasks, i);
+      GmtLibResult *res = g_task_get_task_data (task);
+
+      res->request = op->request;
+      res->result = r;
+      res->queued = start - res->enqueued;
+      res->call = skipped ? 0 : end - start;
+      res->merged = op->tasks->len - 1;
+      res->skipped = skipped;
+
+      g_task_return_boolean (task, TRUE);
+    }
+}
+
+static gpointer
+lib_worker_thread (gpointer user_data)
+{
+  GmtLibWorker *worker = user_data;
+
+  while (TRUE)
+    {
+      LibOp *op;
+
+      g_mutex_lock (&worker->lock);
+
+      while (g_queue_is_empty (&worker->ops) && !worker->quit)
+        g_cond_wait (&worker->cond, &worker->lock);
+
+      /* drain the queue before quitting */
+      op = g_queue_pop_head (&worker->ops);
+
+      g_mutex_unlock (&worker->lock);
+
+      if (op == NULL)
+        break;
+
+      lib_op_run (worker, op);
+      lib_op_free (op);
+    }
+
+  return NULL;
+}
+
+/* public */
+GmtLibWorker *
+gmt_lib_worker_new (void)
+{
+  GmtLibWorker *worker;
+
+  worker = g_slice_new0 (GmtLibWorker);
+  g_mutex_init (&worker->lock);
+  g_cond_init (&worker->cond);
+  g_queue_init (&worker->ops);
+  worker->issued = -1;
+  worker->last_switch = -1;
+
+  worker->thread = g_thread_new ("gmt-libgamemode", lib_worker_thread, worker);
+
+  return worker;
+}
+
+void
+gmt_lib_worker_free (GmtLibWorker *worker)
+{
+  if (worker == NULL)
+    return;
+
+  g_mutex_lock (&worker->lock);
+  worker->quit = TRUE;
+  g_cond_signal (&worker->cond);
+  g_mutex_unlock (&worker->lock);
+
+  g_thread_join (worker->thread);
+
+  g_mutex_clear (&worker->lock);
+  g_cond_clear (&worker->cond);
+  g_slice_free (GmtLibWorker, worker);
+}
+
+/* Queue a library call. If the last queued call, which has not
+ * started yet, is of the same sort (start/end or query), the new
+ * request is merged into it and a start/end takes on the newest
+ * direction. All merged requests get the result of the one call. */
+void
+gmt_lib_worker_request_async (GmtLibWorker       *worker,
+                              GmtLibRequest       request,
+                              gpointer            source_object,
+                              GAsyncReadyCallback callback,
+                              gpointer            user_data)
+{
+  GmtLibResult *res;
+  GTask *task;
+  LibOp *tail;
+
+  g_return_if_fail (worker != NULL);
+
+  res = g_new0 (GmtLibResult, 1);
+  res->request = request;
+  res->enqueued = g_get_monotonic_time ();
+
+  task = g_task_new (source_object, NULL, callback, user_data);
+  g_task_set_task_data (task, res, g_free);
+
+  g_mutex_lock (&worker->lock);
+
+  tail = g_queue_peek_tail (&worker->ops);
+
+  if (tail && request_is_switch (tail->request) == request_is_switch (request))
+    {
+      tail->request = request;
+      tail->merged = TRUE;
+    }
+  else
+    {
+      tail = lib_op_new (request);
+      g_queue_push_tail (&worker->ops, tail);
+    }
+
+  g_ptr_array_add (tail->tasks, task);
+
+  g_cond_signal (&worker->cond);
+  g_mutex_unlock (&worker->lock);
+}
+
+gboolean
+gmt_lib_worker_request_finish (GAsyncResult *res,
+                               GmtLibResult *result,
+                               GError      **error)
+{
+  GTask *task = G_TASK (res);
+  gboolean ok;
+
+  ok = g_task_propagate_boolean (task, error);
+
+  if (ok && result)
+    *result = *(GmtLibResult *) g_task_get_task_data (task);
+
+  return ok;
+}
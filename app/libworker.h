@@ -0,0 +1,59 @@
+/* libworker.h
+ *
+ * Copyright 2019 Christian Kellner
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+typedef enum GmtLibRequest_
+{
+  GMT_LIB_REQUEST_START,  /* gamemode_request_start () */
+  GMT_LIB_REQUEST_END,    /* gamemode_request_end () */
+  GMT_LIB_REQUEST_QUERY,  /* gamemode_query_status () */
+} GmtLibRequest;
+
+typedef struct GmtLibResult_
+{
+  GmtLibRequest request;  /* what was actually done */
+  int           result;   /* return value of the library call */
+  gint64        enqueued; /* monotonic time of the request */
+  gint64        queued;   /* usec spent waiting in the queue */
+  gint64        call;     /* usec spent in the library call */
+  guint         merged;   /* other requests answered by the same call */
+  gboolean      skipped;  /* no call needed, result of the last one */
+} GmtLibResult;
+
+typedef struct GmtLibWorker_ GmtLibWorker;
+
+GmtLibWorker * gmt_lib_worker_new (void);
+
+void           gmt_lib_worker_free (GmtLibWorker *worker);
+
+void           gmt_lib_worker_request_async (GmtLibWorker       *worker,
+                                             GmtLibRequest       request,
+                                             gpointer            source_object,
+                                             GAsyncReadyCallback callback,
+                                             gpointer            user_data);
+
+gboolean       gmt_lib_worker_request_finish (GAsyncResult *res,
+                                              GmtLibResult *result,
+                                              GError      **error);
+
+G_END_DECLS
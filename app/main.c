@@ -19,6 +19,7 @@
 #include <glib/gi18n.h>
 
 #include "config.h"
+#include "startup.h"
 #include "window.h"
 
 static void
@@ -28,6 +29,8 @@ on_activate (GtkApplication *app)
 
   g_assert (GTK_IS_APPLICATION (app));
 
+  gmt_startup_mark (GMT_STARTUP_ACTIVATE);
+
   window = gtk_application_get_active_window (app);
   if (window == NULL)
     {
@@ -39,12 +42,34 @@ on_activate (GtkApplication *app)
   gtk_window_present (window);
 }
 
+/* GApplication connects to the session bus to register,
+ * which happens before ::startup */
+static void
+on_startup (GApplication *app)
+{
+  if (g_application_get_dbus_connection (app) != NULL)
+    gmt_startup_mark (GMT_STARTUP_BUS);
+}
+
+static int
+on_handle_local_options (GApplication *app,
+                         GVariantDict *options,
+                         gpointer      user_data)
+{
+  if (g_variant_dict_contains (options, "prewarm"))
+    gmt_startup_set_prewarm (TRUE);
+
+  return -1;
+}
+
 int
 main (int argc, char **argv)
 {
   g_autoptr(GtkApplication) app = NULL;
   int r;
 
+  gmt_startup_init ();
+
   bindtextdomain (GETTEXT_PACKAGE, LOCALEDIR);
   bind_textdomain_codeset (GETTEXT_PACKAGE, "UTF-8");
   textdomain (GETTEXT_PACKAGE);
@@ -52,6 +77,21 @@ main (int argc, char **argv)
   app = gtk_application_new ("org.gnome.GameModeTester",
                              G_APPLICATION_FLAGS_NONE);
 
+  g_application_add_main_option (G_APPLICATION (app),
+                                 "prewarm", 0,
+                                 G_OPTION_FLAG_NONE,
+                                 G_OPTION_ARG_NONE,
+                                 _("Load libgamemode and connect to the bus in the background at startup"),
+                                 NULL);
+
+  g_signal_connect (app, "handle-local-options",
+                    G_CALLBACK (on_handle_local_options),
+                    NULL);
+
+  g_signal_connect (app, "startup",
+                    G_CALLBACK (on_startup),
+                    NULL);
+
   g_signal_connect (app, "activate",
                     G_CALLBACK (on_activate),
                     NULL);
@@ -0,0 +1,284 @@
+/* perfcount.c
+ *
+ * Copyright 2019 Christian Kellner
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "perfcount.h"
+
+#include <gio/gio.h>
+
+#include <linux/perf_event.h>
+
+#include <errno.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+struct GmtPerf_
+{
+  int      fds[GMT_PERF_N_COUNTERS];  /* -1 if not open */
+  gboolean user_only;
+};
+
+static const struct
+{
+  const char *name;
+  guint32     type;
+  guint64     config;
+} counters[GMT_PERF_N_COUNTERS] = {
+  [GMT_PERF_TASK_CLOCK]       = {"task-clock", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK},
+  [GMT_PERF_CONTEXT_SWITCHES] = {"context-switches", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES},
+  [GMT_PERF_CPU_MIGRATIONS]   = {"cpu-migrations", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS},
+  [GMT_PERF_PAGE_FAULTS]      = {"page-faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+  [GMT_PERF_CYCLES]           = {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+  [GMT_PERF_INSTRUCTIONS]     = {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+};
+
+static int
+perf_open_counter (GmtPerfCounter counter,
+                   pid_t          tid,
+                   int            group_fd,
+                   gboolean       user_only)
+{
+  struct perf_event_attr attr = { 0, };
+  long r;
+
+  attr.size = sizeof (attr);
+  attr.type = counters[counter].type;
+  attr.config = counters[counter].config;
+  attr.read_format = PERF_FORMAT_GROUP |
+                     PERF_FORMAT_TOTAL_TIME_ENABLED |
+                     PERF_FORMAT_TOTAL_TIME_RUNNING;
+  attr.exclude_kernel = user_only;
+  attr.exclude_hv = user_only;
+
+  r = syscall (__NR_perf_event_open, &attr, tid, -1, group_fd, PERF_FLAG_FD_CLOEXEC);
+
+  return (int) r;
+}
+
+static gboolean
+perf_open_group (GmtPerf        *perf,
+                 GmtPerfCounter  first,
+                 GmtPerfCounter  last,
+                 pid_t           tid,
+                 GError        **error)
+{
+  int leader;
+
+  leader = perf_open_counter (first, tid, -1, perf->user_only);
+
+  /* with perf_event_paranoid >= 2 only user space can be measured */
+  if (leader < 0 && (errno == EACCES || errno == EPERM) && !perf->user_only)
+    {
+      perf->user_only = TRUE;
+      leader = perf_open_counter (first, tid, -1, TRUE);
+    }
+
+  if (leader < 0)
+    {
+      int err = errno;
+
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (err),
+                   "could not open %s counter: %s",
+                   counters[first].name, g_strerror (err));
+      return FALSE;
+    }
+
+  perf->fds[first] = leader;
+
+  for (int c = first + 1; c <= (int) last; c++)
+    {
+      perf->fds[c] = perf_open_counter (c, tid, leader, perf->user_only);
+
+      if (perf->fds[c] < 0)
+        g_debug ("could not open %s counter: %s",
+                 counters[c].name, g_strerror (errno));
+    }
+
+  return TRUE;
+}
+
+static gboolean
+perf_read_group (GmtPerf        *perf,
+                 GmtPerfCounter  first,
+                 GmtPerfCounter  last,
+                 GmtPerfValues  *values,
+                 GError        **error)
+{
+  /* nr, time_enabled, time_running, values[nr] */
+  guint64 buf[3 + GMT_PERF_N_COUNTERS];
+  guint64 enabled, running;
+  ssize_t n;
+  guint k = 0;
+
+  if (perf->fds[first] < 0)
+    return TRUE;
+
+  n = read (perf->fds[first], buf, sizeof (buf));
+
+  if (n < (ssize_t) (3 * sizeof (guint64)))
+    {
+      int err = n < 0 ? errno : EIO;
+
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (err),
+                   "could not read %s group: %s",
+                   counters[first].name, g_strerror (err));
+      return FALSE;
+    }
+
+  enabled = buf[1];
+  running = buf[2];
+
+  /* the group never made it onto the pmu */
+  if (running == 0 && enabled > 0)
+    return TRUE;
+
+  for (int c = first; c <= (int) last && k < buf[0]; c++)
+    {
+      guint64 v;
+
+      if (perf->fds[c] < 0)
+        continue;
+
+      v = buf[3 + k++];
+
+      /* scale up if the group was multiplexed */
+      if (running < enabled)
+        v = (guint64) ((double) v * enabled / running);
+
+      values->value[c] = v;
+      values->valid |= 1U << c;
+    }
+
+  return TRUE;
+}
+
+/* public */
+GmtPerf *
+gmt_perf_open (pid_t    tid,
+               GError **error)
+{
+  g_autoptr(GError) err = NULL;
+  GmtPerf *perf;
+  gboolean ok;
+
+  perf = g_slice_new0 (GmtPerf);
+
+  for (int c = 0; c < GMT_PERF_N_COUNTERS; c++)
+    perf->fds[c] = -1;
+
+  ok = perf_open_group (perf,
+                        GMT_PERF_TASK_CLOCK,
+                        GMT_PERF_PAGE_FAULTS,
+                        tid, error);
+
+  if (!ok)
+    {
+      gmt_perf_free (perf);
+      return NULL;
+    }
+
+  /* no pmu in most VMs, software counters only then */
+  ok = perf_open_group (perf,
+                        GMT_PERF_CYCLES,
+                        GMT_PERF_INSTRUCTIONS,
+                        tid, &err);
+
+  if (!ok)
+    g_debug ("hardware counters unavailable: %s", err->message);
+
+  return perf;
+}
+
+void
+gmt_perf_free (GmtPerf *perf)
+{
+  if (perf == NULL)
+    return;
+
+  for (int c = 0; c < GMT_PERF_N_COUNTERS; c++)
+    if (perf->fds[c] > -1)
+      close (perf->fds[c]);
+
+  g_slice_free (GmtPerf, perf);
+}
+
+gboolean
+gmt_perf_has_hardware (GmtPerf *perf)
+{
+  return perf->fds[GMT_PERF_CYCLES] > -1;
+}
+
+/* Kernel and hypervisor are excluded, because we are not
+ * allowed to measure them. Context switches and migrations
+ * happen in the kernel, so they are never counted then. */
+gboolean
+gmt_perf_is_user_only (GmtPerf *perf)
+{
+  return perf->user_only;
+}
+
+gboolean
+gmt_perf_read (GmtPerf       *perf,
+               GmtPerfValues *values,
+               GError       **error)
+{
+  gboolean ok;
+
+  memset (values, 0, sizeof (GmtPerfValues));
+
+  ok = perf_read_group (perf,
+                        GMT_PERF_TASK_CLOCK,
+                        GMT_PERF_PAGE_FAULTS,
+                        values, error);
+
+  if (!ok)
+    return FALSE;
+
+  return perf_read_group (perf,
+                          GMT_PERF_CYCLES,
+                          GMT_PERF_INSTRUCTIONS,
+                          values, error);
+}
+
+void
+gmt_perf_values_add_delta (GmtPerfValues       *sum,
+                           const GmtPerfValues *now,
+                           const GmtPerfValues *base)
+{
+  for (int c = 0; c < GMT_PERF_N_COUNTERS; c++)
+    {
+      if (!(now->valid & (1U << c)))
+        continue;
+
+      /* scaled values of multiplexed groups can jitter */
+      if (now->value[c] > base->value[c])
+        sum->value[c] += now->value[c] - base->value[c];
+
+      sum->valid |= 1U << c;
+    }
+}
+
+const char *
+gmt_perf_counter_name (GmtPerfCounter counter)
+{
+  g_return_val_if_fail (counter < GMT_PERF_N_COUNTERS, NULL);
+
+  return counters[counter].name;
+}
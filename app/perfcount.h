@@ -0,0 +1,69 @@
+/* perfcount.h
+ *
+ * Copyright 2019 Christian Kellner
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <glib.h>
+
+#include <sys/types.h>
+
+G_BEGIN_DECLS
+
+typedef enum GmtPerfCounter_
+{
+  /* software group, led by task-clock */
+  GMT_PERF_TASK_CLOCK,
+  GMT_PERF_CONTEXT_SWITCHES,
+  GMT_PERF_CPU_MIGRATIONS,
+  GMT_PERF_PAGE_FAULTS,
+
+  /* hardware group, led by cycles */
+  GMT_PERF_CYCLES,
+  GMT_PERF_INSTRUCTIONS,
+
+  GMT_PERF_N_COUNTERS
+} GmtPerfCounter;
+
+typedef struct GmtPerfValues_
+{
+  guint64 value[GMT_PERF_N_COUNTERS];
+  guint   valid;    /* bitmask of (1 << GmtPerfCounter) */
+} GmtPerfValues;
+
+typedef struct GmtPerf_ GmtPerf;
+
+GmtPerf    * gmt_perf_open (pid_t    tid,
+                            GError **error);
+
+void         gmt_perf_free (GmtPerf *perf);
+
+gboolean     gmt_perf_has_hardware (GmtPerf *perf);
+
+gboolean     gmt_perf_is_user_only (GmtPerf *perf);
+
+gboolean     gmt_perf_read (GmtPerf       *perf,
+                            GmtPerfValues *values,
+                            GError       **error);
+
+void         gmt_perf_values_add_delta (GmtPerfValues       *sum,
+                                        const GmtPerfValues *now,
+                                        const GmtPerfValues *base);
+
+const char * gmt_perf_counter_name (GmtPerfCounter counter);
+
+G_END_DECLS
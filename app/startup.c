@@ -0,0 +1,196 @@
+/* startup.c
+ *
+ * Copyright 2019 Christian Kellner
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "startup.h"
+
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* monotonic time of each mark, 0 if not reached yet */
+static gint64 startup_marks[GMT_STARTUP_N_MARKS];
+static gboolean startup_prewarm;
+
+static const char *startup_names[GMT_STARTUP_N_MARKS] = {
+  [GMT_STARTUP_PROCESS]          = "process",
+  [GMT_STARTUP_MAIN]             = "main",
+  [GMT_STARTUP_ACTIVATE]         = "activate",
+  [GMT_STARTUP_TEMPLATE]         = "template",
+  [GMT_STARTUP_BUS]              = "bus",
+  [GMT_STARTUP_BUILTIN_CALL]     = "builtin call",
+  [GMT_STARTUP_LIBRARY_CALL]     = "library call",
+  [GMT_STARTUP_REGISTER_REQUEST] = "register request",
+  [GMT_STARTUP_REGISTERED]       = "registered",
+};
+
+static gint64
+timespec_to_usec (const struct timespec *ts)
+{
+  return (gint64) ts->tv_sec * G_USEC_PER_SEC + ts->tv_nsec / 1000;
+}
+
+/* The start time in /proc/self/stat is in clock ticks since
+ * boot, i.e. CLOCK_BOOTTIME with a resolution of 1/HZ; map it
+ * onto the monotonic clock that all other marks use. */
+static gint64
+process_start_time (void)
+{
+  g_autofree char *data = NULL;
+  g_auto(GStrv) fields = NULL;
+  struct timespec boot, mono;
+  guint64 ticks;
+  long hz;
+  char *p;
+
+  if (!g_file_get_contents ("/proc/self/stat", &data, NULL, NULL))
+    return 0;
+
+  /* the command name might contain spaces */
+  p = strrchr (data, ')');
+  if (p == NULL)
+    return 0;
+
+  /* fields after the name start with the state (3), the
+   * start time is field 22 */
+  fields = g_strsplit (p + 2, " ", 21);
+  if (g_strv_length (fields) < 21)
+    return 0;
+
+  ticks = g_ascii_strtoull (fields[19], NULL, 10);
+  hz = sysconf (_SC_CLK_TCK);
+
+  if (hz <= 0)
+    return 0;
+
+  clock_gettime (CLOCK_BOOTTIME, &boot);
+  clock_gettime (CLOCK_MONOTONIC, &mono);
+
+  return timespec_to_usec (&mono) -
+         (timespec_to_usec (&boot) - (gint64) (ticks * G_USEC_PER_SEC / hz));
+}
+
+/* public */
+void
+gmt_startup_init (void)
+{
+  gint64 start = process_start_time ();
+
+  gmt_startup_mark (GMT_STARTUP_MAIN);
+
+  if (start > 0)
+    __atomic_store_n (&startup_marks[GMT_STARTUP_PROCESS], start, __ATOMIC_RELAXED);
+}
+
+/* safe to call from any thread, only the first call counts */
+void
+gmt_startup_mark (GmtStartupMark mark)
+{
+  gint64 unset = 0;
+  gint64 now;
+
+  g_return_if_fail (mark < GMT_STARTUP_N_MARKS);
+
+  if (__atomic_load_n (&startup_marks[mark], __ATOMIC_RELAXED) != 0)
+    return;
+
+  now = g_get_monotonic_time ();
+
+  if (__atomic_compare_exchange_n (&startup_marks[mark], &unset, now, FALSE,
+                                   __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    g_debug ("startup: %s", startup_names[mark]);
+}
+
+/* usec since process start (or main, if that is unknown),
+ * -1 if the mark has not been reached */
+gint64
+gmt_startup_get (GmtStartupMark mark)
+{
+  gint64 origin;
+  gint64 t;
+
+  g_return_val_if_fail (mark < GMT_STARTUP_N_MARKS, -1);
+
+  t = __atomic_load_n (&startup_marks[mark], __ATOMIC_RELAXED);
+
+  if (t == 0)
+    return -1;
+
+  origin = __atomic_load_n (&startup_marks[GMT_STARTUP_PROCESS], __ATOMIC_RELAXED);
+
+  if (origin == 0)
+    origin = __atomic_load_n (&startup_marks[GMT_STARTUP_MAIN], __ATOMIC_RELAXED);
+
+  return MAX (t - origin, 0);
+}
+
+const char *
+gmt_startup_mark_name (GmtStartupMark mark)
+{
+  g_return_val_if_fail (mark < GMT_STARTUP_N_MARKS, NULL);
+
+  return startup_names[mark];
+}
+
+void
+gmt_startup_set_prewarm (gboolean prewarm)
+{
+  startup_prewarm = prewarm;
+}
+
+gboolean
+gmt_startup_get_prewarm (void)
+{
+  return startup_prewarm;
+}
+
+char *
+gmt_startup_report (void)
+{
+  GString *str;
+  gint64 req, reg;
+
+  str = g_string_new (NULL);
+
+  g_string_append_printf (str, "%-16s %10s  (prewarm: %s)\n",
+                          "startup", "ms",
+                          startup_prewarm ? "yes" : "no");
+
+  for (guint i = GMT_STARTUP_MAIN; i < GMT_STARTUP_N_MARKS; i++)
+    {
+      gint64 t = gmt_startup_get (i);
+
+      if (t < 0)
+        g_string_append_printf (str, "%-16s %10s\n", startup_names[i], "-");
+      else
+        g_string_append_printf (str, "%-16s %10.1f\n", startup_names[i], t / 1000.0);
+    }
+
+  req = gmt_startup_get (GMT_STARTUP_REGISTER_REQUEST);
+  reg = gmt_startup_get (GMT_STARTUP_REGISTERED);
+
+  if (req > -1 && reg > -1)
+    g_string_append_printf (str, "first register took %.1f ms\n",
+                            (reg - req) / 1000.0);
+
+  if (str->len > 0)
+    g_string_truncate (str, str->len - 1);
+
+  return g_string_free (str, FALSE);
+}
@@ -0,0 +1,56 @@
+/* startup.h
+ *
+ * Copyright 2019 Christian Kellner
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* points on the way to the first successful register,
+ * each one is recorded the first time it is reached */
+typedef enum GmtStartupMark_
+{
+  GMT_STARTUP_PROCESS,          /* exec, from /proc/self/stat */
+  GMT_STARTUP_MAIN,             /* main () entered */
+  GMT_STARTUP_ACTIVATE,         /* GtkApplication::activate */
+  GMT_STARTUP_TEMPLATE,         /* window template inflated */
+  GMT_STARTUP_BUS,              /* session bus connected */
+  GMT_STARTUP_BUILTIN_CALL,     /* first GDBus call answered */
+  GMT_STARTUP_LIBRARY_CALL,     /* first libgamemode call returned */
+  GMT_STARTUP_REGISTER_REQUEST, /* first register requested */
+  GMT_STARTUP_REGISTERED,       /* first register succeeded */
+
+  GMT_STARTUP_N_MARKS
+} GmtStartupMark;
+
+void         gmt_startup_init (void);
+
+void         gmt_startup_mark (GmtStartupMark mark);
+
+gint64       gmt_startup_get (GmtStartupMark mark);
+
+const char * gmt_startup_mark_name (GmtStartupMark mark);
+
+void         gmt_startup_set_prewarm (gboolean prewarm);
+
+gboolean     gmt_startup_get_prewarm (void);
+
+char       * gmt_startup_report (void);
+
+G_END_DECLS
@@ -0,0 +1,343 @@
+/* gamemode-stub.c
+ *
+ * Copyright 2019 Christian Kellner
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <gio/gio.h>
+#include <gio/gunixfdlist.h>
+#include <glib-unix.h>
+
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* A stand-in for gamemoded that keeps track of registered
+ * games, but does not change any system settings. It follows
+ * the daemon's return codes:
+ *
+ *  Register:    0 registered, -1 already registered or no such process
+ *  Unregister:  0 unregistered, -1 not registered
+ *  QueryStatus: 0 inactive, 1 active but not for the game, 2 active
+ *
+ * Requests are never rejected, i.e. -2 is never returned. */
+
+#define GAMEMODE_DBUS_NAME "com.feralinteractive.GameMode"
+#define GAMEMODE_DBUS_PATH "/com/feralinteractive/GameMode"
+
+static const char introspection_xml[] =
+  "<node>"
+  "  <interface name='com.feralinteractive.GameMode'>"
+  "    <property name='ClientCount' type='i' access='read'/>"
+  "    <method name='RegisterGame'>"
+  "      <arg type='i' name='pid' direction='in'/>"
+  "      <arg type='i' name='result' direction='out'/>"
+  "    </method>"
+  "    <method name='UnregisterGame'>"
+  "      <arg type='i' name='pid' direction='in'/>"
+  "      <arg type='i' name='result' direction='out'/>"
+  "    </method>"
+  "    <method name='QueryStatus'>"
+  "      <arg type='i' name='pid' direction='in'/>"
+  "      <arg type='i' name='result' direction='out'/>"
+  "    </method>"
+  "    <method name='RegisterGameByPID'>"
+  "      <arg type='i' name='callerpid' direction='in'/>"
+  "      <arg type='i' name='gamepid' direction='in'/>"
+  "      <arg type='i' name='result' direction='out'/>"
+  "    </method>"
+  "    <method name='UnregisterGameByPID'>"
+  "      <arg type='i' name='callerpid' direction='in'/>"
+  "      <arg type='i' name='gamepid' direction='in'/>"
+  "      <arg type='i' name='result' direction='out'/>"
+  "    </method>"
+  "    <method name='QueryStatusByPID'>"
+  "      <arg type='i' name='callerpid' direction='in'/>"
+  "      <arg type='i' name='gamepid' direction='in'/>"
+  "      <arg type='i' name='result' direction='out'/>"
+  "    </method>"
+  "    <method name='RegisterGameByPIDFd'>"
+  "      <arg type='h' name='gamepidfd' direction='in'/>"
+  "      <arg type='h' name='callerpidfd' direction='in'/>"
+  "      <arg type='i' name='result' direction='out'/>"
+  "    </method>"
+  "    <method name='UnregisterGameByPIDFd'>"
+  "      <arg type='h' name='gamepidfd' direction='in'/>"
+  "      <arg type='h' name='callerpidfd' direction='in'/>"
+  "      <arg type='i' name='result' direction='out'/>"
+  "    </method>"
+  "    <method name='QueryStatusByPIDFd'>"
+  "      <arg type='h' name='gamepidfd' direction='in'/>"
+  "      <arg type='h' name='callerpidfd' direction='in'/>"
+  "      <arg type='i' name='result' direction='out'/>"
+  "    </method>"
+  "  </interface>"
+  "</node>";
+
+typedef struct Stub_
+{
+  GMainLoop  *loop;
+  GHashTable *games; /* pid -> pid */
+} Stub;
+
+static int
+pidfd_get_pid (int fd)
+{
+  g_autofree char *path = NULL;
+  g_autofree char *data = NULL;
+  const char *p;
+
+  path = g_strdup_printf ("/proc/self/fdinfo/%d", fd);
+
+  if (!g_file_get_contents (path, &data, NULL, NULL))
+    return -1;
+
+  p = strstr (data, "\nPid:");
+
+  if (p == NULL)
+    return -1;
+
+  return (int) g_ascii_strtoll (p + strlen ("\nPid:"), NULL, 10);
+}
+
+static gboolean
+process_exists (int pid)
+{
+  return pid > 0 && (kill (pid, 0) == 0 || errno == EPERM);
+}
+
+static int
+stub_register (Stub *stub,
+               int   pid)
+{
+  gpointer key = GINT_TO_POINTER (pid);
+
+  if (!process_exists (pid) || g_hash_table_contains (stub->games, key))
+    return -1;
+
+  g_hash_table_add (stub->games, key);
+
+  return 0;
+}
+
+static int
+stub_unregister (Stub *stub,
+                 int   pid)
+{
+  return g_hash_table_remove (stub->games, GINT_TO_POINTER (pid)) ? 0 : -1;
+}
+
+static int
+stub_query (Stub *stub,
+            int   pid)
+{
+  if (g_hash_table_size (stub->games) == 0)
+    return 0;
+
+  return g_hash_table_contains (stub->games, GINT_TO_POINTER (pid)) ? 2 : 1;
+}
+
+static int
+stub_dispatch (Stub       *stub,
+               const char *request,
+               int         pid)
+{
+  if (g_str_equal (request, "RegisterGame"))
+    return stub_register (stub, pid);
+  else if (g_str_equal (request, "UnregisterGame"))
+    return stub_unregister (stub, pid);
+
+  return stub_query (stub, pid);
+}
+
+static void
+handle_method_call (GDBusConnection       *connection,
+                    const char            *sender,
+                    const char            *object_path,
+                    const char            *interface_name,
+                    const char            *method_name,
+                    GVariant              *parameters,
+                    GDBusMethodInvocation *invocation,
+                    gpointer               user_data)
+{
+  g_autofree char *request = NULL;
+  Stub *stub = user_data;
+  gint32 caller, game;
+  const char *suffix;
+  int r;
+
+  if ((suffix = g_strrstr (method_name, "ByPIDFd")) != NULL)
+    {
+      GDBusMessage *msg = g_dbus_method_invocation_get_message (invocation);
+      GUnixFDList *fds = g_dbus_message_get_unix_fd_list (msg);
+      gint32 caller_idx, game_idx;
+      int caller_fd, game_fd;
+
+      /* unlike *ByPID, the game comes first */
+      g_variant_get (parameters, "(hh)", &game_idx, &caller_idx);
+
+      if (fds == NULL)
+        {
+          g_dbus_method_invocation_return_error (invocation, G_DBUS_ERROR,
+                                                 G_DBUS_ERROR_INVALID_ARGS,
+                                                 "no file descriptors");
+          return;
+        }
+
+      caller_fd = g_unix_fd_list_get (fds, caller_idx, NULL);
+      game_fd = g_unix_fd_list_get (fds, game_idx, NULL);
+
+      caller = caller_fd > -1 ? pidfd_get_pid (caller_fd) : -1;
+      game = game_fd > -1 ? pidfd_get_pid (game_fd) : -1;
+
+      if (caller_fd > -1)
+        close (caller_fd);
+
+      if (game_fd > -1)
+        close (game_fd);
+    }
+  else if ((suffix = g_strrstr (method_name, "ByPID")) != NULL)
+    {
+      g_variant_get (parameters, "(ii)", &caller, &game);
+    }
+  else
+    {
+      g_variant_get (parameters, "(i)", &game);
+      caller = game;
+    }
+
+  request = suffix ? g_strndup (method_name, suffix - method_name) : g_strdup (method_name);
+
+  r = stub_dispatch (stub, request, game);
+
+  g_debug ("%s (%d, %d) = %d", method_name, caller, game, r);
+
+  g_dbus_method_invocation_return_value (invocation, g_variant_new ("(i)", r));
+}
+
+static GVariant *
+handle_get_property (GDBusConnection *connection,
+                     const char      *sender,
+                     const char      *object_path,
+                     const char      *interface_name,
+                     const char      *property_name,
+                     GError         **error,
+                     gpointer         user_data)
+{
+  Stub *stub = user_data;
+
+  return g_variant_new_int32 ((gint32) g_hash_table_size (stub->games));
+}
+
+static const GDBusInterfaceVTable interface_vtable = {
+  handle_method_call,
+  handle_get_property,
+  NULL,
+};
+
+static void
+on_bus_acquired (GDBusConnection *connection,
+                 const char      *name,
+                 gpointer         user_data)
+{
+  g_autoptr(GDBusNodeInfo) info = NULL;
+  g_autoptr(GError) err = NULL;
+  Stub *stub = user_data;
+  guint id;
+
+  info = g_dbus_node_info_new_for_xml (introspection_xml, &err);
+  g_assert_no_error (err);
+
+  id = g_dbus_connection_register_object (connection,
+                                          GAMEMODE_DBUS_PATH,
+                                          info->interfaces[0],
+                                          &interface_vtable,
+                                          stub,
+                                          NULL,
+                                          &err);
+
+  if (id == 0)
+    {
+      g_printerr ("could not export object: %s\n", err->message);
+      g_main_loop_quit (stub->loop);
+    }
+}
+
+static void
+on_name_acquired (GDBusConnection *connection,
+                  const char      *name,
+                  gpointer         user_data)
+{
+  /* the test runner waits for this */
+  g_print ("ready\n");
+}
+
+static void
+on_name_lost (GDBusConnection *connection,
+              const char      *name,
+              gpointer         user_data)
+{
+  Stub *stub = user_data;
+
+  g_printerr ("lost or could not acquire %s\n", name);
+  g_main_loop_quit (stub->loop);
+}
+
+static gboolean
+on_signal (gpointer user_data)
+{
+  Stub *stub = user_data;
+
+  g_main_loop_quit (stub->loop);
+
+  return G_SOURCE_REMOVE;
+}
+
+int
+main (int argc, char **argv)
+{
+  Stub stub;
+  guint owner;
+
+  /* line buffered, so the runner sees "ready" at once */
+  setvbuf (stdout, NULL, _IOLBF, 0);
+
+  stub.loop = g_main_loop_new (NULL, FALSE);
+  stub.games = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+  g_unix_signal_add (SIGTERM, on_signal, &stub);
+  g_unix_signal_add (SIGINT, on_signal, &stub);
+
+  owner = g_bus_own_name (G_BUS_TYPE_SESSION,
+                          GAMEMODE_DBUS_NAME,
+                          G_BUS_NAME_OWNER_FLAGS_DO_NOT_QUEUE,
+                          on_bus_acquired,
+                          on_name_acquired,
+                          on_name_lost,
+                          &stub,
+                          NULL);
+
+  g_main_loop_run (stub.loop);
+
+  g_bus_unown_name (owner);
+  g_hash_table_unref (stub.games);
+  g_main_loop_unref (stub.loop);
+
+  return EXIT_SUCCESS;
+}
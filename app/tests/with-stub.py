@@ -0,0 +1,81 @@
+#!/usr/bin/env python3
+#
+# Run a command on private session buses that have the
+# GameMode stub on them and exit with the command's status.
+# With more than one bus, the command gets an --address
+# option for each; the session bus is always the first one.
+
+import argparse
+import ctypes.util
+import os
+import subprocess
+import sys
+
+SKIP = 77
+
+
+def start_bus(args, procs):
+    daemon = subprocess.Popen([args.dbus_daemon, '--session', '--nofork',
+                               '--print-address=1'],
+                              stdout=subprocess.PIPE,
+                              universal_newlines=True)
+    procs.append(daemon)
+
+    address = daemon.stdout.readline().strip()
+    if not address:
+        raise RuntimeError('could not start dbus-daemon')
+
+    env = dict(os.environ)
+    env['DBUS_SESSION_BUS_ADDRESS'] = address
+    env.pop('DBUS_STARTER_ADDRESS', None)
+
+    stub = subprocess.Popen([args.stub],
+                            stdout=subprocess.PIPE,
+                            universal_newlines=True,
+                            env=env)
+    procs.append(stub)
+
+    if stub.stdout.readline().strip() != 'ready':
+        raise RuntimeError('GameMode stub did not start')
+
+    return address, env
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('--dbus-daemon', default='dbus-daemon')
+    parser.add_argument('--stub', required=True)
+    parser.add_argument('--buses', type=int, default=1)
+    parser.add_argument('--needs-library', action='store_true',
+                        help='skip if libgamemode is not installed')
+    parser.add_argument('command', nargs=argparse.REMAINDER)
+    args = parser.parse_args()
+
+    command = args.command
+    if command and command[0] == '--':
+        command = command[1:]
+
+    if args.needs_library and not ctypes.util.find_library('gamemode'):
+        print('skipping: libgamemode not found')
+        return SKIP
+
+    procs = []
+
+    try:
+        buses = [start_bus(args, procs) for _ in range(args.buses)]
+
+        if len(buses) > 1:
+            command[1:1] = ['--address=' + address for address, _ in buses]
+
+        return subprocess.call(command, env=buses[0][1])
+    except RuntimeError as e:
+        print(e, file=sys.stderr)
+        return 1
+    finally:
+        for proc in reversed(procs):
+            proc.terminate()
+            proc.wait()
+
+
+if __name__ == '__main__':
+    sys.exit(main())
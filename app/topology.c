@@ -0,0 +1,407 @@
+/* topology.c
+ *
+ * Copyright 2019 Christian Kellner
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "topology.h"
+
+#include <gio/gio.h>
+
+#define SYSFS_CPU_PATH "/sys/devices/system/cpu"
+
+/* sysfs helpers */
+static gboolean
+read_sysfs_int64 (const char *path,
+                  gint64     *out)
+{
+  g_autofree char *data = NULL;
+  gboolean ok;
+
+  ok = g_file_get_contents (path, &data, NULL, NULL);
+
+  if (!ok)
+    return FALSE;
+
+  g_strstrip (data);
+
+  return g_ascii_string_to_signed (data, 10, G_MININT64, G_MAXINT64, out, NULL);
+}
+
+static int
+cpu_read_node (const char *base)
+{
+  g_autoptr(GDir) dir = NULL;
+  const char *name;
+
+  dir = g_dir_open (base, 0, NULL);
+
+  if (dir == NULL)
+    return 0;
+
+  /* cpuN/nodeM is a link to the NUMA node the cpu belongs to */
+  while ((name = g_dir_read_name (dir)) != NULL)
+    {
+      gint64 node;
+      gboolean ok;
+
+      if (!g_str_has_prefix (name, "node"))
+        continue;
+
+      ok = g_ascii_string_to_signed (name + 4, 10, 0, G_MAXINT, &node, NULL);
+      if (ok)
+        return (int) node;
+    }
+
+  return 0;
+}
+
+static int
+cpu_compare_id (gconstpointer a,
+                gconstpointer b)
+{
+  const GmtCpu *x = a;
+  const GmtCpu *y = b;
+
+  return x->id - y->id;
+}
+
+/* siblings of one core are adjacent */
+static int
+cpu_compare_packed (gconstpointer a,
+                    gconstpointer b)
+{
+  const GmtCpu *x = a;
+  const GmtCpu *y = b;
+
+  if (x->bucket != y->bucket)
+    return x->bucket - y->bucket;
+  else if (x->slot != y->slot)
+    return x->slot - y->slot;
+
+  return x->sibling - y->sibling;
+}
+
+/* all first siblings before any second sibling */
+static int
+cpu_compare_primary (gconstpointer a,
+                     gconstpointer b)
+{
+  const GmtCpu *x = a;
+  const GmtCpu *y = b;
+
+  if (x->sibling != y->sibling)
+    return x->sibling - y->sibling;
+
+  return cpu_compare_packed (a, b);
+}
+
+/* like primary, but alternate between node/package pairs */
+static int
+cpu_compare_spread (gconstpointer a,
+                    gconstpointer b)
+{
+  const GmtCpu *x = a;
+  const GmtCpu *y = b;
+
+  if (x->sibling != y->sibling)
+    return x->sibling - y->sibling;
+  else if (x->slot != y->slot)
+    return x->slot - y->slot;
+
+  return x->bucket - y->bucket;
+}
+
+static void
+topology_index (GmtTopology *topo)
+{
+  GArray *cpus = topo->cpus;
+  g_autoptr(GArray) buckets = NULL;
+  g_autoptr(GArray) nodes = NULL;
+
+  buckets = g_array_new (FALSE, FALSE, sizeof (GmtCpu));
+  nodes = g_array_new (FALSE, FALSE, sizeof (int));
+
+  for (guint i = 0; i < cpus->len; i++)
+    {
+      GmtCpu *cpu = &g_array_index (cpus, GmtCpu, i);
+      GmtCpu *primary;
+      guint k;
+
+      for (k = 0; k < nodes->len; k++)
+        if (g_array_index (nodes, int, k) == cpu->node)
+          break;
+
+      if (k == nodes->len)
+        g_array_append_val (nodes, cpu->node);
+
+      for (k = 0; k < buckets->len; k++)
+        {
+          GmtCpu *b = &g_array_index (buckets, GmtCpu, k);
+
+          if (b->node == cpu->node && b->package == cpu->package)
+            break;
+        }
+
+      if (k == buckets->len)
+        g_array_append_val (buckets, *cpu);
+
+      cpu->bucket = (int) k;
+      cpu->sibling = 0;
+      cpu->slot = 0;
+      primary = NULL;
+
+      for (guint j = 0; j < i; j++)
+        {
+          GmtCpu *other = &g_array_index (cpus, GmtCpu, j);
+
+          if (other->package != cpu->package)
+            continue;
+
+          if (other->core == cpu->core)
+            {
+              if (cpu->sibling++ == 0)
+                primary = other;
+            }
+          else if (other->sibling == 0 && other->bucket == cpu->bucket)
+            {
+              cpu->slot++;
+            }
+        }
+
+      if (primary != NULL)
+        cpu->slot = primary->slot;
+      else
+        topo->n_cores++;
+    }
+
+  topo->n_nodes = nodes->len;
+  topo->n_buckets = buckets->len;
+}
+
+/* public */
+GmtTopology *
+gmt_topology_load (GError **error)
+{
+  g_autoptr(GmtTopology) topo = NULL;
+  g_autoptr(GDir) dir = NULL;
+  const char *name;
+
+  dir = g_dir_open (SYSFS_CPU_PATH, 0, error);
+
+  if (dir == NULL)
+    return NULL;
+
+  topo = g_new0 (GmtTopology, 1);
+  topo->cpus = g_array_new (FALSE, TRUE, sizeof (GmtCpu));
+
+  while ((name = g_dir_read_name (dir)) != NULL)
+    {
+      g_autofree char *base = NULL;
+      g_autofree char *path = NULL;
+      GmtCpu cpu = { 0, };
+      gint64 val;
+      gboolean ok;
+
+      if (!g_str_has_prefix (name, "cpu"))
+        continue;
+
+      ok = g_ascii_string_to_signed (name + 3, 10, 0, G_MAXINT, &val, NULL);
+      if (!ok)
+        continue;
+
+      cpu.id = (int) val;
+      base = g_build_filename (SYSFS_CPU_PATH, name, NULL);
+
+      /* offline cpus have no topology information */
+      path = g_build_filename (base, "topology", "core_id", NULL);
+      if (!read_sysfs_int64 (path, &val))
+        continue;
+
+      cpu.core = (int) val;
+
+      g_free (path);
+      path = g_build_filename (base, "topology", "physical_package_id", NULL);
+      cpu.package = read_sysfs_int64 (path, &val) ? (int) val : 0;
+
+      g_free (path);
+      path = g_build_filename (base, "cpufreq", "cpuinfo_max_freq", NULL);
+      cpu.max_freq = read_sysfs_int64 (path, &val) ? val : -1;
+
+      cpu.node = cpu_read_node (base);
+
+      g_array_append_val (topo->cpus, cpu);
+    }
+
+  if (topo->cpus->len == 0)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND,
+                   "no cpu topology information in %s", SYSFS_CPU_PATH);
+      return NULL;
+    }
+
+  g_array_sort (topo->cpus, cpu_compare_id);
+  topology_index (topo);
+
+  g_debug ("topology: %u cpus, %u cores, %u nodes",
+           topo->cpus->len, topo->n_cores, topo->n_nodes);
+
+  return g_steal_pointer (&topo);
+}
+
+void
+gmt_topology_free (GmtTopology *topo)
+{
+  if (topo == NULL)
+    return;
+
+  g_array_unref (topo->cpus);
+  g_free (topo);
+}
+
+const GmtCpu *
+gmt_topology_lookup_cpu (GmtTopology *topo,
+                         int          id)
+{
+  if (topo == NULL || id < 0)
+    return NULL;
+
+  for (guint i = 0; i < topo->cpus->len; i++)
+    {
+      const GmtCpu *cpu = &g_array_index (topo->cpus, GmtCpu, i);
+
+      if (cpu->id == id)
+        return cpu;
+    }
+
+  return NULL;
+}
+
+/* Returns an array of @n_workers cpu ids, one per worker,
+ * where -1 means the worker should not be pinned. If there
+ * are more workers than candidate cpus, the plan wraps. */
+GArray *
+gmt_topology_plan (GmtTopology *topo,
+                   GmtPlacement placement,
+                   guint        n_workers)
+{
+  g_autoptr(GArray) order = NULL;
+  GCompareFunc compare;
+  GArray *plan;
+  int node = G_MAXINT;
+
+  plan = g_array_sized_new (FALSE, FALSE, sizeof (int), n_workers);
+
+  if (placement == GMT_PLACEMENT_NONE || topo == NULL)
+    {
+      int any = -1;
+
+      for (guint i = 0; i < n_workers; i++)
+        g_array_append_val (plan, any);
+
+      return plan;
+    }
+
+  for (guint i = 0; i < topo->cpus->len; i++)
+    node = MIN (node, g_array_index (topo->cpus, GmtCpu, i).node);
+
+  order = g_array_sized_new (FALSE, FALSE, sizeof (GmtCpu), topo->cpus->len);
+
+  for (guint i = 0; i < topo->cpus->len; i++)
+    {
+      const GmtCpu *cpu = &g_array_index (topo->cpus, GmtCpu, i);
+
+      if (placement == GMT_PLACEMENT_PHYSICAL && cpu->sibling > 0)
+        continue;
+      else if (placement == GMT_PLACEMENT_NODE && cpu->node != node)
+        continue;
+
+      g_array_append_val (order, *cpu);
+    }
+
+  switch (placement)
+    {
+    case GMT_PLACEMENT_SMT_PACKED:
+      compare = cpu_compare_packed;
+      break;
+
+    case GMT_PLACEMENT_SPREAD:
+      compare = cpu_compare_spread;
+      break;
+
+    default:
+      compare = cpu_compare_primary;
+      break;
+    }
+
+  g_array_sort (order, compare);
+
+  for (guint i = 0; i < n_workers; i++)
+    {
+      const GmtCpu *cpu = &g_array_index (order, GmtCpu, i % order->len);
+
+      g_array_append_val (plan, cpu->id);
+    }
+
+  return plan;
+}
+
+gint64
+gmt_cpu_read_cur_freq (int cpu)
+{
+  g_autofree char *path = NULL;
+  char name[32];
+  gint64 val;
+
+  if (cpu < 0)
+    return -1;
+
+  g_snprintf (name, sizeof (name), "cpu%d", cpu);
+  path = g_build_filename (SYSFS_CPU_PATH, name,
+                           "cpufreq", "scaling_cur_freq", NULL);
+
+  if (!read_sysfs_int64 (path, &val))
+    return -1;
+
+  return val;
+}
+
+static const char *placement_names[] = {
+  [GMT_PLACEMENT_NONE]       = "none",
+  [GMT_PLACEMENT_PHYSICAL]   = "physical",
+  [GMT_PLACEMENT_SMT_PACKED] = "smt-packed",
+  [GMT_PLACEMENT_NODE]       = "node",
+  [GMT_PLACEMENT_SPREAD]     = "spread",
+};
+
+const char *
+gmt_placement_to_string (GmtPlacement placement)
+{
+  g_return_val_if_fail (placement < G_N_ELEMENTS (placement_names), NULL);
+
+  return placement_names[placement];
+}
+
+GmtPlacement
+gmt_placement_from_string (const char *str)
+{
+  for (guint i = 0; str && i < G_N_ELEMENTS (placement_names); i++)
+    if (g_str_equal (str, placement_names[i]))
+      return (GmtPlacement) i;
+
+  return GMT_PLACEMENT_NONE;
+}
@@ -0,0 +1,73 @@
+/* topology.h
+ *
+ * Copyright 2019 Christian Kellner
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef enum GmtPlacement_
+{
+  GMT_PLACEMENT_NONE,       /* let the scheduler decide */
+  GMT_PLACEMENT_PHYSICAL,   /* one worker per physical core */
+  GMT_PLACEMENT_SMT_PACKED, /* fill all SMT siblings of a core first */
+  GMT_PLACEMENT_NODE,       /* stay on the first NUMA node */
+  GMT_PLACEMENT_SPREAD,     /* round-robin over nodes and packages */
+} GmtPlacement;
+
+typedef struct GmtCpu_
+{
+  int    id;
+  int    core;      /* topology/core_id */
+  int    package;   /* topology/physical_package_id */
+  int    node;      /* NUMA node, 0 if unknown */
+  int    sibling;   /* index among the SMT siblings of the core */
+  int    slot;      /* index of the core within its node/package */
+  int    bucket;    /* index of the node/package pair */
+  gint64 max_freq;  /* cpufreq/cpuinfo_max_freq in kHz, -1 if unknown */
+} GmtCpu;
+
+typedef struct GmtTopology_
+{
+  GArray *cpus;     /* GmtCpu, sorted by id */
+  guint   n_cores;
+  guint   n_nodes;
+  guint   n_buckets;
+} GmtTopology;
+
+GmtTopology   * gmt_topology_load (GError **error);
+
+void            gmt_topology_free (GmtTopology *topo);
+
+const GmtCpu  * gmt_topology_lookup_cpu (GmtTopology *topo,
+                                         int          id);
+
+GArray        * gmt_topology_plan (GmtTopology *topo,
+                                   GmtPlacement placement,
+                                   guint        n_workers);
+
+gint64          gmt_cpu_read_cur_freq (int cpu);
+
+const char    * gmt_placement_to_string (GmtPlacement placement);
+
+GmtPlacement    gmt_placement_from_string (const char *str);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (GmtTopology, gmt_topology_free)
+
+G_END_DECLS
@@ -19,7 +19,12 @@
 #include "config.h"
 
 #include "window.h"
-#include "gamemode_client.h"
+#include "bench.h"
+#include "call.h"
+#include "libworker.h"
+#include "startup.h"
+#include "topology.h"
+#include "work.h"
 
 #include <gio/gio.h>
 #include <gio/gunixfdlist.h>
@@ -33,6 +38,8 @@
 #include <math.h>
 #include <limits.h>
 
+#define GMT_BENCH_ITERATIONS 100
+
 struct _GmtWindow
 {
   GtkApplicationWindow parent_instance;
@@ -45,12 +52,17 @@ struct _GmtWindow
   GtkLabel     *lbl_flatpak;
   GtkLabel     *lbl_status;
   GtkButton    *btn_refresh;
+  GtkLabel     *lbl_libcall;
+  GtkLabel     *lbl_startup;
 
   GtkComboBox  *cbx_call;
   GtkEntry     *txt_target;
   GtkEntry     *txt_requester;
   GtkButton    *btn_call;
   GtkLabel     *lbl_result;
+  GtkButton    *btn_bench;
+  GtkToggleButton *chk_steady;
+  GtkLabel     *lbl_bench;
 
 
   /* config */
@@ -61,11 +73,20 @@ struct _GmtWindow
   int pid;
 
   /*  */
-  GDBusProxy *gamemode;
+  GDBusProxy   *gamemode;
+  GmtBench     *bench;
+  GmtLibWorker *lib;
+  guint         lib_pending;
 
   /*  */
-  GtkSwitch    *sw_work;
-  GCancellable *work_cancel;
+  GtkSwitch       *sw_work;
+  GtkComboBoxText *cbx_placement;
+  GtkSpinButton   *spn_workers;
+  GtkLabel        *lbl_work;
+  GCancellable    *work_cancel;
+  GmtTopology     *topo;
+  GmtWork         *work;
+  guint            work_report_id;
 };
 
 G_DEFINE_TYPE (GmtWindow, gmt_window, GTK_TYPE_APPLICATION_WINDOW)
@@ -73,10 +94,6 @@ G_DEFINE_TYPE (GmtWindow, gmt_window, GTK_TYPE_APPLICATION_WINDOW)
 #define GET_PRIV(self) G_STRUCT_MEMBER_P (self, BoltExported_private_offset)
 
 /* prototypes */
-static void     on_bus_ready (GObject      *source,
-                              GAsyncResult *res,
-                              gpointer      user_data);
-
 static void     gmt_builtin_gamemode_switch (GmtWindow *self,
                                              gboolean   enable);
 
@@ -109,6 +126,11 @@ static void     on_docall_clicked (GmtWindow *self,
 static void     on_call_selected  (GmtWindow *self,
                                    GtkComboBox *widget);
 
+static void     on_bench_clicked (GmtWindow *self,
+                                  GtkButton *button);
+
+static void     gmt_window_prewarm (GmtWindow *self);
+
 static gboolean on_work_toggled (GmtWindow *self,
                                  gboolean   enable,
                                  GtkSwitch *toggle);
@@ -118,11 +140,49 @@ int gmt_setup_socket (GmtWindow          *self,
                       socklen_t          *sl);
 /* private stuff */
 
+static void
+gmt_window_dispose (GObject *object)
+{
+  GmtWindow *self = GMT_WINDOW (object);
+
+  /* the work's task keeps us alive until the last worker
+   * has exited; without a cancellable, work_stopped knows
+   * that the widgets are gone */
+  if (self->work_cancel)
+    g_cancellable_cancel (self->work_cancel);
+
+  g_clear_object (&self->work_cancel);
+
+  if (self->work_report_id)
+    {
+      g_source_remove (self->work_report_id);
+      self->work_report_id = 0;
+    }
+
+  G_OBJECT_CLASS (gmt_window_parent_class)->dispose (object);
+}
+
+static void
+gmt_window_finalize (GObject *object)
+{
+  GmtWindow *self = GMT_WINDOW (object);
+
+  g_clear_object (&self->work_cancel);
+  g_clear_pointer (&self->topo, gmt_topology_free);
+  g_clear_pointer (&self->lib, gmt_lib_worker_free);
+
+  G_OBJECT_CLASS (gmt_window_parent_class)->finalize (object);
+}
+
 static void
 gmt_window_class_init (GmtWindowClass *klass)
 {
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
   GtkWidgetClass *widget_class = GTK_WIDGET_CLASS (klass);
 
+  gobject_class->dispose = gmt_window_dispose;
+  gobject_class->finalize = gmt_window_finalize;
+
   gtk_widget_class_set_template_from_resource (widget_class, "/org/gnome/GameModeTester/window.ui");
   gtk_widget_class_bind_template_child (widget_class, GmtWindow, header_bar);
   gtk_widget_class_bind_template_child (widget_class, GmtWindow, lbl_pid);
@@ -131,29 +191,30 @@ gmt_window_class_init (GmtWindowClass *klass)
   gtk_widget_class_bind_template_child (widget_class, GmtWindow, lbl_flatpak);
   gtk_widget_class_bind_template_child (widget_class, GmtWindow, lbl_status);
   gtk_widget_class_bind_template_child (widget_class, GmtWindow, btn_refresh);
+  gtk_widget_class_bind_template_child (widget_class, GmtWindow, lbl_libcall);
+  gtk_widget_class_bind_template_child (widget_class, GmtWindow, lbl_startup);
   gtk_widget_class_bind_template_child (widget_class, GmtWindow, sw_work);
+  gtk_widget_class_bind_template_child (widget_class, GmtWindow, cbx_placement);
+  gtk_widget_class_bind_template_child (widget_class, GmtWindow, spn_workers);
+  gtk_widget_class_bind_template_child (widget_class, GmtWindow, lbl_work);
 
   gtk_widget_class_bind_template_child (widget_class, GmtWindow, cbx_call);
   gtk_widget_class_bind_template_child (widget_class, GmtWindow, txt_target);
   gtk_widget_class_bind_template_child (widget_class, GmtWindow, txt_requester);
   gtk_widget_class_bind_template_child (widget_class, GmtWindow, btn_call);
   gtk_widget_class_bind_template_child (widget_class, GmtWindow, lbl_result);
+  gtk_widget_class_bind_template_child (widget_class, GmtWindow, btn_bench);
+  gtk_widget_class_bind_template_child (widget_class, GmtWindow, chk_steady);
+  gtk_widget_class_bind_template_child (widget_class, GmtWindow, lbl_bench);
 
   gtk_widget_class_bind_template_callback (widget_class, on_gamemode_toggled);
   gtk_widget_class_bind_template_callback (widget_class, on_refresh_clicked);
   gtk_widget_class_bind_template_callback (widget_class, on_call_selected);
   gtk_widget_class_bind_template_callback (widget_class, on_docall_clicked);
+  gtk_widget_class_bind_template_callback (widget_class, on_bench_clicked);
   gtk_widget_class_bind_template_callback (widget_class, on_work_toggled);
 }
 
-#define GAMEMODE_DBUS_NAME "com.feralinteractive.GameMode"
-#define GAMEMODE_DBUS_IFACE "com.feralinteractive.GameMode"
-#define GAMEMODE_DBUS_PATH "/com/feralinteractive/GameMode"
-
-#define PORTAL_DBUS_NAME "org.freedesktop.portal.Desktop"
-#define PORTAL_DBUS_IFACE "org.freedesktop.portal.GameMode"
-#define PORTAL_DBUS_PATH "/org/freedesktop/portal/desktop"
-
 static int
 in_flatpak (void)
 {
@@ -165,10 +226,20 @@ in_flatpak (void)
   return r == 0 && sb.st_size > 0;
 }
 
+static void
+startup_show (GmtWindow *self)
+{
+  g_autofree char *txt = NULL;
+
+  txt = gmt_startup_report ();
+  gtk_label_set_text (self->lbl_startup, txt);
+}
+
 static void
 gmt_window_init (GmtWindow *self)
 {
   g_autoptr(GCredentials) creds = NULL;
+  g_autoptr(GError) err = NULL;
   g_autofree char *pidstr = NULL;
   gboolean boxed;
 
@@ -177,6 +248,7 @@ gmt_window_init (GmtWindow *self)
   self->portal = boxed;
 
   gtk_widget_init_template (GTK_WIDGET (self));
+  gmt_startup_mark (GMT_STARTUP_TEMPLATE);
 
   creds = g_credentials_new ();
   self->pid = g_credentials_get_unix_pid (creds, NULL);
@@ -185,6 +257,7 @@ gmt_window_init (GmtWindow *self)
   gtk_label_set_text (self->lbl_pid, pidstr);
 
   self->uselib = TRUE;
+  self->lib = gmt_lib_worker_new ();
   g_signal_connect_object (self->sw_uselib, "notify::active",
                            G_CALLBACK (on_uselib_notify),
                            self, 0);
@@ -198,6 +271,22 @@ gmt_window_init (GmtWindow *self)
   gtk_entry_set_text (self->txt_requester, pidstr);
 
   self->work_cancel = g_cancellable_new ();
+
+  self->topo = gmt_topology_load (&err);
+
+  if (self->topo == NULL)
+    g_warning ("could not read cpu topology: %s", err->message);
+
+  gtk_widget_set_sensitive (GTK_WIDGET (self->cbx_placement), self->topo != NULL);
+  gtk_combo_box_set_active_id (GTK_COMBO_BOX (self->cbx_placement), "none");
+
+  if (self->topo)
+    gtk_spin_button_set_value (self->spn_workers, self->topo->n_cores);
+
+  startup_show (self);
+
+  if (gmt_startup_get_prewarm ())
+    gmt_window_prewarm (self);
 }
 
 static void
@@ -223,6 +312,9 @@ on_gamemode_toggled (GmtWindow *self,
 
   gmt_startstop_operation (self, TRUE);
 
+  if (enable)
+    gmt_startup_mark (GMT_STARTUP_REGISTER_REQUEST);
+
   g_debug ("use gamemode library: %s", (self->uselib ? "yes" :  "no"));
 
   if (self->uselib)
@@ -272,6 +364,16 @@ gamemode_toggle_finish (GmtWindow *self, int r)
 
   g_signal_handlers_unblock_by_func (self->sw_gamemode, on_gamemode_toggled, self);
 
+  if (active && r == 0)
+    {
+      gmt_startup_mark (GMT_STARTUP_REGISTERED);
+      startup_show (self);
+    }
+
+  /* start a new measurement window for the workload */
+  if (self->work)
+    gmt_work_set_gamemode (self->work, gtk_switch_get_state (self->sw_gamemode));
+
   gmt_startstop_operation (self, FALSE);
 }
 
@@ -314,12 +416,13 @@ refresh_finish (GmtWindow *self, int r)
 }
 
 static const char *
-call_get_id (GmtWindow *self, gint *args)
+call_get_id (GmtWindow *self, gint *args, gboolean *pidfd)
 {
-  g_auto(GValue) val = G_VALUE_INIT;
   GtkTreeModel *model;
   GtkTreeIter iter;
   gboolean ok;
+  gint n_args;
+  gboolean use_fd;
 
   model = gtk_combo_box_get_model (self->cbx_call);
   ok = gtk_combo_box_get_active_iter (self->cbx_call, &iter);
@@ -327,158 +430,73 @@ call_get_id (GmtWindow *self, gint *args)
   if (!ok)
     return NULL;
 
-  gtk_tree_model_get_value (model, &iter, 2, &val);
+  gtk_tree_model_get (model, &iter, 2, &n_args, 3, &use_fd, -1);
 
   if (args)
-    *args = g_value_get_int (&val);
-
-  return gtk_combo_box_get_active_id (self->cbx_call);
-}
-
-static void
-on_call_selected (GmtWindow *self,
-                  GtkComboBox *box)
-{
-  const char *method;
-  gint args;
-
-  method = call_get_id (self, &args);
-
-  if (method == NULL)
-    return;
-
-  gtk_widget_set_sensitive (GTK_WIDGET (self->txt_requester), args > 1);
-  gtk_widget_set_visible (GTK_WIDGET (self->txt_requester), args > 1);
-}
-
-/* native gamemode implementation */
-typedef struct CallData_
-{
-  char       *method;
-  GVariant   *params;
-  gboolean    portal;
-  GDBusProxy *proxy;
-} CallData;
+    *args = n_args;
 
-static void
-call_data_free (gpointer data)
-{
-  CallData *call = data;
+  if (pidfd)
+    *pidfd = use_fd;
 
-  g_free (call->method);
-  g_variant_unref (call->params);
-  g_clear_object (&call->proxy);
-  g_slice_free (CallData, call);
+  return gtk_combo_box_get_active_id (self->cbx_call);
 }
 
-static void
-on_gamemode_call_ready (GObject      *source,
-                        GAsyncResult *res,
-                        gpointer      user_data)
+static gboolean
+call_get_pids (GmtWindow *self,
+               gboolean   with_requester,
+               gint32    *target,
+               gint32    *requester)
 {
   g_autoptr(GError) err = NULL;
-  g_autoptr(GVariant) val = NULL;
-  GTask *task = G_TASK (user_data);
-  CallData *call;
-  int r = -1;
-
-  call = g_task_get_task_data (task);
+  const char *txt;
+  gboolean ok;
+  gint64 val;
 
-  val = g_dbus_proxy_call_finish (G_DBUS_PROXY (call->proxy), res, &err);
-  if (val == NULL)
-    {
-      g_warning ("could not talk to gamemode: %s", err->message);
-      g_task_return_error (task, g_steal_pointer (&err));
-      return;
-    }
+  txt = gtk_entry_get_text (self->txt_target);
+  ok = g_ascii_string_to_signed (txt, 10, 1, G_MAXINT32, &val, &err);
 
-  g_variant_get (val, "(i)", &r);
-  if (r < 0)
+  if (!ok)
     {
-      g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_FAILED,
-                               "GameMode error"); //TODO: better error message
-      return;
+      g_warning ("Failed to parse target pid: %s", err->message);
+      return FALSE;
     }
 
-  g_task_return_int (task, r);
-  g_object_unref (task);
-}
+  *target = (gint32) val;
 
-static void
-on_bus_ready (GObject      *source,
-              GAsyncResult *res,
-              gpointer      user_data)
-{
-  g_autoptr(GError) err = NULL;
-  GTask *task = user_data;
-  CallData *call;
-  const char *name;
+  if (!with_requester)
+    return TRUE;
 
-  call = g_task_get_task_data (task);
-  call->proxy = g_dbus_proxy_new_for_bus_finish (res, &err);
+  txt = gtk_entry_get_text (self->txt_requester);
+  ok = g_ascii_string_to_signed (txt, 10, 1, G_MAXINT32, &val, &err);
 
-  if (call->proxy == NULL)
+  if (!ok)
     {
-      g_warning ("could not create gamemode proxy: %s", err->message);
-      g_task_return_error (task, g_steal_pointer (&err));
-      return;
+      g_warning ("Failed to parse requestor pid: %s", err->message);
+      return FALSE;
     }
-  name = g_dbus_connection_get_unique_name (g_dbus_proxy_get_connection (call->proxy));
 
-  g_debug ("my name: %s", name);
+  *requester = (gint32) val;
 
-  g_dbus_proxy_call (G_DBUS_PROXY (call->proxy),
-                     call->method,
-                     call->params,
-                     G_DBUS_CALL_FLAGS_NONE,
-                     -1,
-                     NULL, /* cancel */
-                     on_gamemode_call_ready,
-                     task);
+  return TRUE;
 }
 
 static void
-call_gamemode (GmtWindow          *window,
-               const char         *method,
-               GVariant           *params,
-               gboolean            portal,
-               GAsyncReadyCallback callback,
-               gpointer            user_data)
-{
-  CallData *data;
-  GTask *task;
-  GDBusProxyFlags flags;
-
-  data = g_slice_new0 (CallData);
-  data->method = g_strdup (method);
-  data->params = g_variant_ref_sink (params);
-  data->portal = portal;
-
-  task = g_task_new (window, NULL, callback, user_data);
-  g_task_set_task_data (task, data, call_data_free);
-
-  flags = G_DBUS_PROXY_FLAGS_DO_NOT_AUTO_START_AT_CONSTRUCTION;
-  g_dbus_proxy_new_for_bus (G_BUS_TYPE_SESSION,
-                            flags, NULL,
-                            portal ? PORTAL_DBUS_NAME : GAMEMODE_DBUS_NAME,
-                            portal ? PORTAL_DBUS_PATH : GAMEMODE_DBUS_PATH,
-                            portal ? PORTAL_DBUS_IFACE : GAMEMODE_DBUS_IFACE,
-                            NULL,
-                            on_bus_ready,
-                            task);
-}
-
-static int
-call_gamemode_finish (GAsyncResult *res,
-                      GError      **error)
+on_call_selected (GmtWindow *self,
+                  GtkComboBox *box)
 {
-  gssize r;
+  const char *method;
+  gint args;
 
-  r = g_task_propagate_int (G_TASK (res), error);
+  method = call_get_id (self, &args, NULL);
 
-  return (int) r;
+  if (method == NULL)
+    return;
+
+  gtk_widget_set_sensitive (GTK_WIDGET (self->txt_requester), args > 1);
+  gtk_widget_set_visible (GTK_WIDGET (self->txt_requester), args > 1);
 }
 
+/* native gamemode implementation */
 static void
 on_builtin_switch_ready (GObject      *source,
                          GAsyncResult *res,
@@ -488,7 +506,7 @@ on_builtin_switch_ready (GObject      *source,
   GmtWindow *self = user_data;
   int r = -1;
 
-  r = call_gamemode_finish (res, &err);
+  r = gmt_call_gamemode_finish (res, &err);
   if (r < 0)
     g_warning ("could not talk to gamemode: %s", err->message);
 
@@ -506,12 +524,14 @@ gmt_builtin_gamemode_switch (GmtWindow *self,
 
   params = g_variant_new ("(i)", self->pid);
 
-  call_gamemode (self,
-                 mode,
-                 params,
-                 self->portal,
-                 on_builtin_switch_ready,
-                 self);
+  gmt_call_gamemode (self,
+                     NULL,
+                     mode,
+                     params,
+                     NULL,
+                     self->portal,
+                     on_builtin_switch_ready,
+                     self);
 }
 
 static void
@@ -523,7 +543,7 @@ on_builtin_query_status_ready (GObject      *source,
   GmtWindow *self = user_data;
   int r = -1;
 
-  r = call_gamemode_finish (res, &err);
+  r = gmt_call_gamemode_finish (res, &err);
   if (r < 0)
     g_warning ("could not talk to gamemode: %s", err->message);
 
@@ -539,31 +559,36 @@ gmt_builtin_query_status (GmtWindow *self)
 
   params = g_variant_new ("(i)", self->pid);
 
-  call_gamemode (self,
-                 "QueryStatus",
-                 params,
-                 self->portal,
-                 on_builtin_query_status_ready,
-                 self);
+  gmt_call_gamemode (self,
+                     NULL,
+                     "QueryStatus",
+                     params,
+                     NULL,
+                     self->portal,
+                     on_builtin_query_status_ready,
+                     self);
 
 }
 
 /* gamemode library */
 static void
-switch_gamemode_thread (GTask        *task,
-                        gpointer      source_object,
-                        gpointer      task_data,
-                        GCancellable *cancellable)
+library_show_timing (GmtWindow          *self,
+                     const GmtLibResult *res)
 {
-  gboolean enable = !!GPOINTER_TO_INT (task_data);
-  int r;
+  g_autofree char *txt = NULL;
+  g_autofree char *extra = NULL;
 
-  if (enable)
-    r = gamemode_request_start ();
-  else
-    r = gamemode_request_end ();
+  if (res->skipped)
+    extra = g_strdup_printf (", skipped, %u merged", res->merged);
+  else if (res->merged > 0)
+    extra = g_strdup_printf (", %u merged", res->merged);
 
-  g_task_return_int (task, r);
+  txt = g_strdup_printf ("queued %.2f ms, call %.2f ms%s",
+                         res->queued / 1000.0,
+                         res->call / 1000.0,
+                         extra ? extra : "");
+
+  gtk_label_set_text (self->lbl_libcall, txt);
 }
 
 static void
@@ -571,37 +596,44 @@ on_library_switch_ready (GObject      *source,
                          GAsyncResult *res,
                          gpointer      user_data)
 {
-  g_autoptr(GTask) task = G_TASK (res);
+  g_autoptr(GError) err = NULL;
   GmtWindow *wnd = GMT_WINDOW (source);
-  int r;
+  GmtLibResult result;
+  gboolean ok;
+
+  ok = gmt_lib_worker_request_finish (res, &result, &err);
 
-  r = (int) g_task_propagate_int (task, NULL);
+  if (!ok)
+    {
+      g_warning ("gamemode library request failed: %s", err->message);
+      result.result = -1;
+    }
+  else
+    {
+      library_show_timing (wnd, &result);
+    }
 
-  gamemode_toggle_finish (wnd, r);
+  /* only the answer to the latest toggle decides the state */
+  if (--wnd->lib_pending > 0)
+    return;
+
+  gamemode_toggle_finish (wnd, result.result);
 }
 
 static void
 gmt_library_gamemode_switch (GmtWindow *self,
                              gboolean   enable)
 {
-  GTask *task;
+  GmtLibRequest request;
 
-  task = g_task_new (self, NULL, on_library_switch_ready, self);
-  g_task_set_task_data (task, GINT_TO_POINTER ((gint) enable), NULL);
-  g_task_run_in_thread (task, switch_gamemode_thread);
-}
+  request = enable ? GMT_LIB_REQUEST_START : GMT_LIB_REQUEST_END;
 
-static void
-query_status_thread (GTask        *task,
-                     gpointer      source_object,
-                     gpointer      task_data,
-                     GCancellable *cancellable)
-{
-  int r;
-
-  r = gamemode_query_status ();
+  self->lib_pending++;
+  gmt_lib_worker_request_async (self->lib, request, self,
+                                on_library_switch_ready, self);
 
-  g_task_return_int (task, r);
+  /* keep toggling, the worker merges what is still queued */
+  gtk_widget_set_sensitive (GTK_WIDGET (self->sw_gamemode), TRUE);
 }
 
 static void
@@ -609,22 +641,89 @@ on_status_thread_ready (GObject      *source,
                         GAsyncResult *res,
                         gpointer      user_data)
 {
-  g_autoptr(GTask) task = G_TASK (res);
+  g_autoptr(GError) err = NULL;
   GmtWindow *wnd = GMT_WINDOW (source);
-  int r;
+  GmtLibResult result;
+  gboolean ok;
+
+  ok = gmt_lib_worker_request_finish (res, &result, &err);
 
-  r = (int) g_task_propagate_int (task, NULL);
+  if (!ok)
+    {
+      g_warning ("gamemode library request failed: %s", err->message);
+      result.result = -1;
+    }
+  else
+    {
+      library_show_timing (wnd, &result);
+    }
 
-  refresh_finish (wnd, r);
+  refresh_finish (wnd, result.result);
 }
 
 static void
 gmt_library_query_status (GmtWindow *self)
 {
-  GTask *task;
+  gmt_lib_worker_request_async (self->lib, GMT_LIB_REQUEST_QUERY, self,
+                                on_status_thread_ready, self);
+}
+
+/* startup */
+static void
+on_prewarm_library_ready (GObject      *source,
+                          GAsyncResult *res,
+                          gpointer      user_data)
+{
+  g_autoptr(GError) err = NULL;
+  GmtWindow *self = GMT_WINDOW (source);
+  GmtLibResult result;
+
+  if (!gmt_lib_worker_request_finish (res, &result, &err))
+    g_warning ("could not prewarm gamemode library: %s", err->message);
+  else
+    g_debug ("prewarm: library ready (%d)", result.result);
 
-  task = g_task_new (self, NULL, on_status_thread_ready, self);
-  g_task_run_in_thread (task, query_status_thread);
+  startup_show (self);
+}
+
+static void
+on_prewarm_call_ready (GObject      *source,
+                       GAsyncResult *res,
+                       gpointer      user_data)
+{
+  g_autoptr(GError) err = NULL;
+  GmtWindow *self = GMT_WINDOW (source);
+  int r;
+
+  r = gmt_call_gamemode_finish (res, &err);
+  g_debug ("prewarm: builtin ready (%d)", r);
+
+  startup_show (self);
+}
+
+/* Do the expensive first-time work before the user toggles:
+ * the library query makes libgamemode dlopen itself and the
+ * builtin query connects to the bus and wakes up the daemon */
+static void
+gmt_window_prewarm (GmtWindow *self)
+{
+  GVariant *params;
+
+  g_debug ("prewarming");
+
+  gmt_lib_worker_request_async (self->lib, GMT_LIB_REQUEST_QUERY, self,
+                                on_prewarm_library_ready, self);
+
+  params = g_variant_new ("(i)", self->pid);
+
+  gmt_call_gamemode (self,
+                     NULL,
+                     "QueryStatus",
+                     params,
+                     NULL,
+                     self->portal,
+                     on_prewarm_call_ready,
+                     self);
 }
 
 /* custom calls */
@@ -638,7 +737,7 @@ on_docall_ready (GObject      *source,
   GmtWindow *self = user_data;
   int r = -1;
 
-  r = call_gamemode_finish (res, &err);
+  r = gmt_call_gamemode_finish (res, &err);
   if (r < 0)
     g_warning ("could not talk to gamemode: %s", err->message);
 
@@ -653,106 +752,152 @@ static void
 on_docall_clicked (GmtWindow *self,
                    GtkButton *button)
 {
+  g_autoptr(GUnixFDList) fds = NULL;
   g_autoptr(GError) err = NULL;
   GVariant *params;
+  const char *request;
   const char *method;
-  const char *txt;
   gboolean ok;
-  gint64 target = 0;
-  gint64 requester = 0;
+  gboolean pidfd;
+  gint32 target = 0;
+  gint32 requester = 0;
+  GmtCallArgs call_args;
   gint args;
 
-  method = call_get_id (self, &args);
+  request = call_get_id (self, &args, &pidfd);
 
-  if (method == NULL)
+  if (request == NULL)
     return;
 
-  txt = gtk_entry_get_text (self->txt_target);
-  ok = g_ascii_string_to_signed (txt, 10, 1, G_MAXINT32, &target, &err);
+  ok = call_get_pids (self, args > 1, &target, &requester);
 
   if (!ok)
-    {
-      g_warning ("Failed to parse target pid: %s", err->message);
-      return;
-      }
+    return;
 
-  if (args > 1)
-    {
-      txt = gtk_entry_get_text (self->txt_requester);
-      ok = g_ascii_string_to_signed (txt, 10, 1, G_MAXINT32, &requester, &err);
+  if (pidfd)
+    call_args = GMT_CALL_ARGS_PIDFD_PAIR;
+  else if (args > 1)
+    call_args = GMT_CALL_ARGS_PID_PAIR;
+  else
+    call_args = GMT_CALL_ARGS_PID;
 
-      if (!ok)
-        {
-          g_warning ("Failed to parse requestor pid: %s", err->message);
-          return;
-        }
+  params = gmt_call_params (request, call_args, self->portal,
+                            target, requester, -1, -1,
+                            &method, &fds, &err);
 
-      params = g_variant_new ("(ii)", (gint32) target, (gint32) requester);
-    }
-  else
+  if (params == NULL)
     {
-      params = g_variant_new ("(i)", (gint32) target);
+      g_warning ("Failed to prepare call: %s", err->message);
+      return;
     }
 
-  g_debug ("do call: %s %i %i", method, (gint32) target, (gint32) requester);
+  g_debug ("do call: %s %i %i", method, target, requester);
   gmt_startstop_operation (self, TRUE);
 
-  call_gamemode (self,
-                 method,
-                 params,
-                 self->portal,
-                 on_docall_ready,
-                 self);
+  gmt_call_gamemode (self,
+                     NULL,
+                     method,
+                     params,
+                     fds,
+                     self->portal,
+                     on_docall_ready,
+                     self);
 
 }
 
-/*  */
+/* latency benchmark */
+static void
+on_bench_ready (GObject      *source,
+                GAsyncResult *res,
+                gpointer      user_data)
+{
+  g_autoptr(GError) err = NULL;
+  g_autofree char *txt = NULL;
+  GmtWindow *self = GMT_WINDOW (source);
+  gboolean ok;
 
+  ok = gmt_bench_run_finish (self->bench, res, &err);
 
-static gboolean is_prime(long long unsigned int num, GCancellable *c) {
-  /* no sqrt(num) optimization, because we
-   * want the extra work */
-  for (int i = 2; i < num && !g_cancellable_is_cancelled (c); i++)
-    if (num % i == 0)
-      return FALSE;
+  if (!ok)
+    g_warning ("Benchmark failed: %s", err->message);
 
-  return TRUE;
+  txt = gmt_bench_format (self->bench);
+  gtk_label_set_text (self->lbl_bench, txt);
+
+  g_clear_pointer (&self->bench, gmt_bench_free);
+
+  gtk_widget_set_sensitive (GTK_WIDGET (self->btn_bench), TRUE);
+  gmt_startstop_operation (self, FALSE);
 }
 
 static void
-calc_primes (GTask *task,
-             gpointer source_object,
-             gpointer task_data,
-             GCancellable *cancellable)
+on_bench_clicked (GmtWindow *self,
+                  GtkButton *button)
 {
-  while (!g_cancellable_is_cancelled (cancellable))
-    {
+  gint32 target = 0;
+  gint32 requester = 0;
+  gboolean steady;
+  gboolean ok;
 
-      for (long long unsigned int i = 2; i < ULLONG_MAX; i++)
-        {
-          gboolean isp;
+  if (self->bench != NULL)
+    return;
 
-          isp = is_prime (i, cancellable);
-          if (isp)
-            g_print("Found %llu to be prime\n", i);
+  ok = call_get_pids (self, TRUE, &target, &requester);
 
-          if (g_cancellable_is_cancelled (cancellable))
-            break;
-          }
-      }
+  if (!ok)
+    return;
+
+  gmt_startstop_operation (self, TRUE);
+  gtk_widget_set_sensitive (GTK_WIDGET (self->btn_bench), FALSE);
+  gtk_label_set_text (self->lbl_bench, "running...");
 
-  g_task_return_boolean (task, TRUE);
+  steady = gtk_toggle_button_get_active (self->chk_steady);
+
+  self->bench = gmt_bench_new (GMT_BENCH_ITERATIONS,
+                               target,
+                               requester,
+                               self->portal,
+                               steady);
+  gmt_bench_run_async (self->bench, self, NULL, on_bench_ready, NULL);
+}
+
+/* work simulation */
+static gboolean
+on_work_report (gpointer user_data)
+{
+  GmtWindow *self = GMT_WINDOW (user_data);
+  g_autofree char *report = NULL;
+
+  report = gmt_work_report (self->work);
+  gtk_label_set_text (self->lbl_work, report);
+
+  return G_SOURCE_CONTINUE;
 }
 
 static void
-work_stopped (GObject *source_object,
+work_stopped (GObject      *source_object,
               GAsyncResult *res,
-              gpointer user_data)
+              gpointer      user_data)
 {
-  GTask *task = G_TASK (res);
-  GmtWindow *self = g_task_get_source_object (task);
+  GmtWindow *self = GMT_WINDOW (source_object);
+
+  gmt_work_run_finish (self->work, res, NULL);
+
+  if (self->work_report_id)
+    {
+      g_source_remove (self->work_report_id);
+      self->work_report_id = 0;
+    }
+
+  g_clear_pointer (&self->work, gmt_work_free);
+
+  /* disposed while running */
+  if (self->work_cancel == NULL)
+    return;
 
   gtk_widget_set_sensitive (GTK_WIDGET (self->sw_work), TRUE);
+  gtk_widget_set_sensitive (GTK_WIDGET (self->cbx_placement), self->topo != NULL);
+  gtk_widget_set_sensitive (GTK_WIDGET (self->spn_workers), TRUE);
   g_cancellable_reset (self->work_cancel);
   gtk_switch_set_state (self->sw_work, FALSE);
 }
@@ -764,19 +909,32 @@ on_work_toggled (GmtWindow *self,
 {
   if (enable)
     {
-      g_autoptr(GTask) task = NULL;
+      GmtPlacement placement;
+      const char *id;
+      guint n;
 
-      task = g_task_new (self, self->work_cancel, work_stopped, NULL);
-      g_task_run_in_thread (task, calc_primes);
+      id = gtk_combo_box_get_active_id (GTK_COMBO_BOX (self->cbx_placement));
+      placement = gmt_placement_from_string (id);
+      n = (guint) gtk_spin_button_get_value_as_int (self->spn_workers);
+
+      self->work = gmt_work_new (self->topo, placement, n);
+      gmt_work_set_gamemode (self->work, gtk_switch_get_state (self->sw_gamemode));
+      gmt_work_run_async (self->work, self, self->work_cancel, work_stopped, NULL);
+
+      self->work_report_id = g_timeout_add_seconds (1, on_work_report, self);
+
+      gtk_widget_set_sensitive (GTK_WIDGET (self->cbx_placement), FALSE);
+      gtk_widget_set_sensitive (GTK_WIDGET (self->spn_workers), FALSE);
       gtk_switch_set_state (self->sw_work, TRUE);
     }
   else
     {
+      /* final numbers, while the counters are still live */
+      on_work_report (self);
+
       gtk_widget_set_sensitive (GTK_WIDGET (toggle), FALSE);
       g_cancellable_cancel (self->work_cancel);
     }
 
   return TRUE;
 }
-
-
@@ -0,0 +1,527 @@
+/* work.c
+ *
+ * Copyright 2019 Christian Kellner
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "work.h"
+#include "perfcount.h"
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <limits.h>
+
+typedef struct GmtWorker_
+{
+  GmtWork *work;
+  guint    index;
+  int      cpu;      /* pinned cpu, -1 if not pinned */
+  GThread *thread;
+
+  /* written by the worker, read by the reporter */
+  guint64  ops;      /* trial divisions done */
+  int      last_cpu; /* cpu the worker last ran on */
+
+  /* counters, opened by the worker itself */
+  gint     perf_state;
+  GmtPerf *perf;
+  char    *perf_error;
+
+  /* reporter state */
+  guint64       ops_prev;
+  GmtPerfValues perf_base;
+} GmtWorker;
+
+enum {
+  PERF_PENDING,
+  PERF_READY,
+  PERF_FAILED
+};
+
+/* counter deltas of one measurement window */
+typedef struct WorkWindow_
+{
+  gboolean      valid;
+  gint64        usec;
+  GmtPerfValues values;
+} WorkWindow;
+
+struct GmtWork_
+{
+  GmtTopology  *topo;
+  GmtPlacement  placement;
+
+  GmtWorker    *workers;
+  guint         n_workers;
+
+  GCancellable *cancellable;
+  GTask        *task;
+  gint          running;
+
+  gint64        last_report;
+
+  /* measurement windows, by GameMode state */
+  gboolean      gamemode;
+  gint64        window_start;
+  WorkWindow     windows[2];
+};
+
+GmtWork *
+gmt_work_new (GmtTopology *topo,
+              GmtPlacement placement,
+              guint        n_workers)
+{
+  g_autoptr(GArray) plan = NULL;
+  GmtWork *work;
+
+  g_return_val_if_fail (n_workers > 0, NULL);
+
+  plan = gmt_topology_plan (topo, placement, n_workers);
+
+  work = g_slice_new0 (GmtWork);
+  work->topo = topo;
+  work->placement = placement;
+  work->n_workers = n_workers;
+  work->workers = g_new0 (GmtWorker, n_workers);
+
+  for (guint i = 0; i < n_workers; i++)
+    {
+      GmtWorker *worker = &work->workers[i];
+
+      worker->work = work;
+      worker->index = i;
+      worker->cpu = g_array_index (plan, int, i);
+      worker->last_cpu = -1;
+    }
+
+  return work;
+}
+
+void
+gmt_work_free (GmtWork *work)
+{
+  if (work == NULL)
+    return;
+
+  if (work->cancellable)
+    g_cancellable_cancel (work->cancellable);
+
+  for (guint i = 0; i < work->n_workers; i++)
+    {
+      GmtWorker *worker = &work->workers[i];
+
+      if (worker->thread)
+        g_thread_join (worker->thread);
+
+      gmt_perf_free (worker->perf);
+      g_free (worker->perf_error);
+    }
+
+  g_clear_object (&work->cancellable);
+  g_clear_object (&work->task);
+  g_free (work->workers);
+  g_slice_free (GmtWork, work);
+}
+
+/* worker threads */
+static gboolean
+is_prime (long long unsigned int num,
+          guint64               *ops,
+          GCancellable          *c)
+{
+  /* no sqrt(num) optimization, because we
+   * want the extra work */
+  for (long long unsigned int i = 2; i < num && !g_cancellable_is_cancelled (c); i++)
+    {
+      (*ops)++;
+
+      if (num % i == 0)
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+static void
+worker_pin (GmtWorker *worker)
+{
+  cpu_set_t set;
+  int r;
+
+  if (worker->cpu < 0)
+    return;
+
+  CPU_ZERO (&set);
+  CPU_SET (worker->cpu, &set);
+
+  r = pthread_setaffinity_np (pthread_self (), sizeof (set), &set);
+
+  if (r != 0)
+    g_warning ("could not pin worker %u to cpu %d: %s",
+               worker->index, worker->cpu, g_strerror (r));
+}
+
+static void
+worker_open_perf (GmtWorker *worker)
+{
+  g_autoptr(GError) err = NULL;
+
+  worker->perf = gmt_perf_open (0, &err);
+
+  if (worker->perf == NULL)
+    {
+      worker->perf_error = g_strdup (err->message);
+      g_atomic_int_set (&worker->perf_state, PERF_FAILED);
+      return;
+    }
+
+  g_atomic_int_set (&worker->perf_state, PERF_READY);
+}
+
+static gpointer
+calc_primes (gpointer user_data)
+{
+  GmtWorker *worker = user_data;
+  GmtWork *work = worker->work;
+  GCancellable *cancellable = work->cancellable;
+  guint64 ops = 0;
+
+  worker_pin (worker);
+  worker_open_perf (worker);
+
+  while (!g_cancellable_is_cancelled (cancellable))
+    {
+
+      for (long long unsigned int i = 2; i < ULLONG_MAX; i++)
+        {
+          gboolean isp;
+
+          isp = is_prime (i, &ops, cancellable);
+          if (isp)
+            g_debug ("Worker %u found %llu to be prime", worker->index, i);
+
+          __atomic_store_n (&worker->ops, ops, __ATOMIC_RELAXED);
+          g_atomic_int_set (&worker->last_cpu, sched_getcpu ());
+
+          if (g_cancellable_is_cancelled (cancellable))
+            break;
+        }
+    }
+
+  /* the last worker out reports back */
+  if (g_atomic_int_dec_and_test (&work->running))
+    {
+      GTask *task = g_steal_pointer (&work->task);
+
+      g_task_return_boolean (task, TRUE);
+      g_object_unref (task);
+    }
+
+  return NULL;
+}
+
+void
+gmt_work_run_async (GmtWork            *work,
+                    gpointer            source_object,
+                    GCancellable       *cancellable,
+                    GAsyncReadyCallback callback,
+                    gpointer            user_data)
+{
+  g_return_if_fail (work->task == NULL);
+
+  work->task = g_task_new (source_object, cancellable, callback, user_data);
+  work->cancellable = cancellable ? g_object_ref (cancellable) : g_cancellable_new ();
+  work->running = (gint) work->n_workers;
+  work->last_report = g_get_monotonic_time ();
+  work->window_start = work->last_report;
+
+  g_debug ("starting %u workers, placement: %s",
+           work->n_workers, gmt_placement_to_string (work->placement));
+
+  for (guint i = 0; i < work->n_workers; i++)
+    {
+      GmtWorker *worker = &work->workers[i];
+      g_autofree char *name = NULL;
+
+      name = g_strdup_printf ("gmt-work-%u", i);
+      worker->thread = g_thread_new (name, calc_primes, worker);
+    }
+}
+
+gboolean
+gmt_work_run_finish (GmtWork      *work,
+                     GAsyncResult *res,
+                     GError      **error)
+{
+  g_return_val_if_fail (g_task_is_valid (res, NULL), FALSE);
+
+  return g_task_propagate_boolean (G_TASK (res), error);
+}
+
+/* measurement windows */
+static void
+work_window_update (GmtWork *work,
+                    gboolean rebase)
+{
+  WorkWindow *window = &work->windows[work->gamemode ? 1 : 0];
+  GmtPerfValues sum = { 0, };
+  gint64 now;
+
+  now = g_get_monotonic_time ();
+
+  for (guint i = 0; i < work->n_workers; i++)
+    {
+      GmtWorker *worker = &work->workers[i];
+      g_autoptr(GError) err = NULL;
+      GmtPerfValues cur;
+      gboolean ok;
+
+      if (g_atomic_int_get (&worker->perf_state) != PERF_READY)
+        continue;
+
+      ok = gmt_perf_read (worker->perf, &cur, &err);
+
+      if (!ok)
+        {
+          g_debug ("worker %u: %s", i, err->message);
+          continue;
+        }
+
+      gmt_perf_values_add_delta (&sum, &cur, &worker->perf_base);
+
+      if (rebase)
+        worker->perf_base = cur;
+    }
+
+  window->valid = TRUE;
+  window->usec = now - work->window_start;
+  window->values = sum;
+
+  if (rebase)
+    work->window_start = now;
+}
+
+/* Ends the current measurement window and starts a new one
+ * for the given GameMode state. The counters are read once
+ * at each window boundary. */
+void
+gmt_work_set_gamemode (GmtWork *work,
+                       gboolean active)
+{
+  if (g_atomic_int_get (&work->running) > 0)
+    work_window_update (work, TRUE);
+
+  work->gamemode = active;
+}
+
+/* reporting */
+static const char *
+format_freq (char  *buf,
+             gsize  len,
+             gint64 khz)
+{
+  if (khz < 0)
+    return "-";
+
+  g_snprintf (buf, len, "%" G_GINT64_FORMAT, khz / 1000);
+  return buf;
+}
+
+static void
+format_rate (char             *buf,
+             gsize             len,
+             const WorkWindow *window,
+             GmtPerfCounter    c,
+             double            scale)
+{
+  double secs = window->usec / (double) G_USEC_PER_SEC;
+
+  if (!window->valid || !(window->values.valid & (1U << c)) || secs <= 0)
+    g_strlcpy (buf, "-", len);
+  else
+    g_snprintf (buf, len, "%.2f", window->values.value[c] / secs / scale);
+}
+
+static void
+work_report_perf (GmtWork *work,
+                  GString *str)
+{
+  static const struct
+  {
+    GmtPerfCounter counter;
+    const char    *unit;
+    double         scale;
+  } rows[] = {
+    {GMT_PERF_TASK_CLOCK, "ms/s", 1e6},
+    {GMT_PERF_CONTEXT_SWITCHES, "/s", 1},
+    {GMT_PERF_CPU_MIGRATIONS, "/s", 1},
+    {GMT_PERF_PAGE_FAULTS, "/s", 1},
+    {GMT_PERF_CYCLES, "M/s", 1e6},
+    {GMT_PERF_INSTRUCTIONS, "M/s", 1e6},
+  };
+  const char *error = NULL;
+  gboolean ready = FALSE;
+  gboolean hw = FALSE;
+  gboolean user_only = FALSE;
+  char off[32], on[32];
+
+  for (guint i = 0; i < work->n_workers; i++)
+    {
+      GmtWorker *worker = &work->workers[i];
+      gint state = g_atomic_int_get (&worker->perf_state);
+
+      if (state == PERF_READY)
+        {
+          ready = TRUE;
+          hw = hw || gmt_perf_has_hardware (worker->perf);
+          user_only = user_only || gmt_perf_is_user_only (worker->perf);
+        }
+      else if (state == PERF_FAILED)
+        {
+          error = worker->perf_error;
+        }
+    }
+
+  if (!ready)
+    {
+      if (error)
+        g_string_append_printf (str, "\n\nperf counters unavailable: %s", error);
+      return;
+    }
+
+  work_window_update (work, FALSE);
+
+  g_string_append_printf (str, "\n\n%-22s %10s %10s\n", "GameMode", "off", "on");
+
+  for (guint i = 0; i < G_N_ELEMENTS (rows); i++)
+    {
+      g_autofree char *name = NULL;
+      GmtPerfCounter c = rows[i].counter;
+
+      name = g_strdup_printf ("%s %s", gmt_perf_counter_name (c), rows[i].unit);
+
+      /* these only happen in the kernel, i.e. always read 0 */
+      if (user_only && (c == GMT_PERF_CONTEXT_SWITCHES || c == GMT_PERF_CPU_MIGRATIONS))
+        {
+          g_strlcpy (off, "-", sizeof (off));
+          g_strlcpy (on, "-", sizeof (on));
+        }
+      else
+        {
+          format_rate (off, sizeof (off), &work->windows[0], c, rows[i].scale);
+          format_rate (on, sizeof (on), &work->windows[1], c, rows[i].scale);
+        }
+
+      g_string_append_printf (str, "%-22s %10s %10s\n", name, off, on);
+    }
+
+  for (guint k = 0; k < 2; k++)
+    {
+      const WorkWindow *window = &work->windows[k];
+      const guint both = (1U << GMT_PERF_CYCLES) | (1U << GMT_PERF_INSTRUCTIONS);
+      char *buf = k ? on : off;
+
+      if (window->valid && (window->values.valid & both) == both &&
+          window->values.value[GMT_PERF_CYCLES] > 0)
+        g_snprintf (buf, sizeof (off), "%.2f",
+                    window->values.value[GMT_PERF_INSTRUCTIONS] /
+                    (double) window->values.value[GMT_PERF_CYCLES]);
+      else
+        g_strlcpy (buf, "-", sizeof (off));
+    }
+
+  g_string_append_printf (str, "%-22s %10s %10s\n", "IPC", off, on);
+
+  for (guint k = 0; k < 2; k++)
+    {
+      const WorkWindow *window = &work->windows[k];
+      char *buf = k ? on : off;
+
+      if (window->valid)
+        g_snprintf (buf, sizeof (off), "%.1f", window->usec / (double) G_USEC_PER_SEC);
+      else
+        g_strlcpy (buf, "-", sizeof (off));
+    }
+
+  g_string_append_printf (str, "%-22s %10s %10s", "window s", off, on);
+
+  if (user_only)
+    g_string_append (str, "\nuser space only, see perf_event_paranoid");
+
+  if (!hw)
+    g_string_append (str, "\nno hardware counters, software only");
+}
+
+/* Per worker throughput since the last report, next to
+ * the current frequency of the cpu it is running on. */
+char *
+gmt_work_report (GmtWork *work)
+{
+  GString *str;
+  gint64 now;
+  double secs;
+  double total = 0;
+
+  now = g_get_monotonic_time ();
+  secs = (now - work->last_report) / (double) G_USEC_PER_SEC;
+  work->last_report = now;
+
+  str = g_string_new (NULL);
+  g_string_append_printf (str, "%-4s %5s %4s %4s %4s %6s %6s %8s\n",
+                          "wrk", "cpu", "core", "pkg", "node",
+                          "MHz", "max", "Mdiv/s");
+
+  for (guint i = 0; i < work->n_workers; i++)
+    {
+      GmtWorker *worker = &work->workers[i];
+      const GmtCpu *info;
+      char cur[32], max[32];
+      guint64 ops;
+      double rate = 0;
+      int cpu;
+
+      ops = __atomic_load_n (&worker->ops, __ATOMIC_RELAXED);
+      cpu = worker->cpu > -1 ? worker->cpu : g_atomic_int_get (&worker->last_cpu);
+      info = gmt_topology_lookup_cpu (work->topo, cpu);
+
+      if (secs > 0)
+        rate = (ops - worker->ops_prev) / secs / 1e6;
+
+      worker->ops_prev = ops;
+      total += rate;
+
+      g_string_append_printf (str, "%-4u %4d%c %4d %4d %4d %6s %6s %8.2f\n",
+                              i, cpu, worker->cpu > -1 ? ' ' : '*',
+                              info ? info->core : -1,
+                              info ? info->package : -1,
+                              info ? info->node : -1,
+                              format_freq (cur, sizeof (cur), gmt_cpu_read_cur_freq (cpu)),
+                              format_freq (max, sizeof (max), info ? info->max_freq : -1),
+                              rate);
+    }
+
+  g_string_append_printf (str, "%-4s %5s %4s %4s %4s %6s %6s %8.2f",
+                          "all", "", "", "", "", "", "", total);
+
+  if (work->placement == GMT_PLACEMENT_NONE)
+    g_string_append (str, "\n* not pinned, last seen cpu");
+
+  work_report_perf (work, str);
+
+  return g_string_free (str, FALSE);
+}
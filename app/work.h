@@ -0,0 +1,50 @@
+/* work.h
+ *
+ * Copyright 2019 Christian Kellner
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+
+#include "topology.h"
+
+G_BEGIN_DECLS
+
+typedef struct GmtWork_ GmtWork;
+
+GmtWork  * gmt_work_new (GmtTopology *topo,
+                         GmtPlacement placement,
+                         guint        n_workers);
+
+void       gmt_work_free (GmtWork *work);
+
+void       gmt_work_run_async (GmtWork            *work,
+                               gpointer            source_object,
+                               GCancellable       *cancellable,
+                               GAsyncReadyCallback callback,
+                               gpointer            user_data);
+
+gboolean   gmt_work_run_finish (GmtWork      *work,
+                                GAsyncResult *res,
+                                GError      **error);
+
+void       gmt_work_set_gamemode (GmtWork *work,
+                                  gboolean active);
+
+char     * gmt_work_report (GmtWork *work);
+
+G_END_DECLS